@@ -0,0 +1,39 @@
+#ifndef KMEANS_ASSIGNMENT_STRATEGY_HPP
+#define KMEANS_ASSIGNMENT_STRATEGY_HPP
+
+/**
+ * @file AssignmentStrategy.hpp
+ *
+ * @brief Strategies for assigning observations to their closest centers.
+ */
+
+namespace kmeans {
+
+/**
+ * Strategy to use for finding the closest center to each observation.
+ *
+ * - `AUTOMATIC` chooses between `VANTAGE_POINT_TREE` and `BRUTE_FORCE` based on a cost model involving the number of observations, centers and dimensions.
+ *   The tree is generally chosen for low-dimensional data with many centers, and the brute-force scan is chosen otherwise.
+ *   The chosen strategy is reported in `Details::assignment_strategy`.
+ * - `VANTAGE_POINT_TREE` builds a vantage point tree from the centers and searches it for each observation.
+ *   This is most effective for low-dimensional data with many centers, where the tree can prune most of the distance calculations.
+ * - `BRUTE_FORCE` computes the distance from each observation to every center.
+ *   The centers are laid out so that the compiler can vectorize the distance calculations for several centers at once.
+ *   This yields the same results as `VANTAGE_POINT_TREE` (up to the breaking of ties between equidistant centers),
+ *   and is faster for small numbers of centers or high-dimensional data, where the tree cannot prune many distance calculations.
+ * - `BLOCKED_DOT_PRODUCT` computes the squared distance between each observation \f$x\f$ and center \f$c\f$ as \f$\|x\|^2 - 2x \cdot c + \|c\|^2\f$.
+ *   The dot products are computed in blocks of observations and centers, similar to a matrix multiplication, to make better use of the CPU cache and registers.
+ *   This is most effective for high-dimensional data where the vantage point tree degenerates into a brute-force search anyway.
+ *   Note that the expansion is less numerically accurate than a direct calculation of the distances, so the assignments may differ slightly when an observation is (nearly) equidistant to multiple centers.
+ *   For this reason, it is never chosen by `AUTOMATIC`.
+ */
+enum class AssignmentStrategy : char {
+    AUTOMATIC,
+    VANTAGE_POINT_TREE,
+    BRUTE_FORCE,
+    BLOCKED_DOT_PRODUCT
+};
+
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef KMEANS_BLOCKEDSEARCH_HPP
+#define KMEANS_BLOCKEDSEARCH_HPP
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+
+namespace kmeans {
+
+namespace internal {
+
+/*
+ * Brute-force nearest-center search that computes the squared distance as
+ * ||x||^2 - 2 x.c + ||c||^2, which allows us to use a matrix multiplication-
+ * like kernel across a block of observations and centers. As ||x||^2 is the
+ * same for all centers, we don't even need to compute it to find the closest
+ * center. We use register blocking on a small tile of observations and
+ * centers, and cache blocking across chunks of centers so that each chunk is
+ * re-used for all observations in the block.
+ *
+ * Note that the expansion is susceptible to cancellation when the
+ * observations are far from the origin relative to their distances from the
+ * centers, so the results may differ slightly from QuickSearch in the
+ * presence of near-ties.
+ */
+template<typename Float_, typename Index_, typename Dim_>
+class BlockedSearch {
+private:
+    static constexpr size_t block_size = 64;
+    static constexpr size_t tile_size = 4;
+    static constexpr size_t center_chunk = 256;
+
+    Dim_ my_num_dim = 0;
+    size_t my_long_num_dim = 0;
+    Index_ my_num_centers = 0;
+    const Float_* my_centers = NULL;
+    std::vector<Float_> my_center_norms;
+
+public:
+    BlockedSearch() = default;
+
+    BlockedSearch(Dim_ ndim, Index_ ncenters, const Float_* centers) {
+        reset(ndim, ncenters, centers);
+    }
+
+    void reset(Dim_ ndim, Index_ ncenters, const Float_* centers) {
+        my_num_dim = ndim;
+        my_long_num_dim = ndim;
+        my_num_centers = ncenters;
+        my_centers = centers;
+
+        my_center_norms.resize(ncenters);
+        for (Index_ c = 0; c < ncenters; ++c) {
+            auto cptr = centers + static_cast<size_t>(c) * my_long_num_dim; // cast to avoid overflow.
+            Float_ norm = 0;
+            for (Dim_ d = 0; d < ndim; ++d) {
+                norm += cptr[d] * cptr[d];
+            }
+            my_center_norms[c] = norm;
+        }
+    }
+
+public:
+    struct Workspace {
+        Workspace() = default;
+        Workspace(size_t ndim) : queries(ndim * block_size) {}
+
+        std::vector<Float_> queries;
+        size_t num_queries = 0;
+
+        Index_ best[block_size];
+        Index_ second[block_size];
+        Float_ best_score[block_size];
+        Float_ second_score[block_size];
+    };
+
+    Workspace create_workspace() const {
+        return Workspace(my_long_num_dim);
+    }
+
+private:
+    template<typename Query_>
+    void add(Workspace& work, const Query_* query) const {
+        auto dest = work.queries.data() + work.num_queries * my_long_num_dim;
+        for (Dim_ d = 0; d < my_num_dim; ++d) {
+            dest[d] = query[d]; // cast to ensure consistent precision regardless of Query_.
+        }
+        ++work.num_queries;
+    }
+
+private:
+    template<bool second_>
+    void update(Workspace& work, size_t q, Index_ c, Float_ score) const {
+        if (score < work.best_score[q]) {
+            if constexpr(second_) {
+                work.second_score[q] = work.best_score[q];
+                work.second[q] = work.best[q];
+            }
+            work.best_score[q] = score;
+            work.best[q] = c;
+        } else if constexpr(second_) {
+            if (score < work.second_score[q]) {
+                work.second_score[q] = score;
+                work.second[q] = c;
+            }
+        }
+    }
+
+    template<bool second_>
+    void search(Workspace& work) const {
+        auto nq = work.num_queries;
+        std::fill_n(work.best_score, nq, std::numeric_limits<Float_>::max());
+        std::fill_n(work.best, nq, 0);
+        if constexpr(second_) {
+            std::fill_n(work.second_score, nq, std::numeric_limits<Float_>::max());
+            std::fill_n(work.second, nq, 0);
+        }
+
+        const Float_* queries = work.queries.data();
+        size_t ncenters = my_num_centers;
+        size_t full_q = (nq / tile_size) * tile_size;
+
+        for (size_t chunk_start = 0; chunk_start < ncenters; chunk_start += center_chunk) {
+            size_t chunk_end = std::min(ncenters, chunk_start + center_chunk);
+            size_t full_c = chunk_start + ((chunk_end - chunk_start) / tile_size) * tile_size;
+
+            for (size_t q = 0; q < full_q; q += tile_size) {
+                const Float_* qptr = queries + q * my_long_num_dim;
+
+                size_t c = chunk_start;
+                for (; c < full_c; c += tile_size) {
+                    const Float_* cptr = my_centers + c * my_long_num_dim;
+
+                    // Accumulating a 4x4 tile of dot products in registers.
+                    Float_ acc[tile_size][tile_size] = {};
+                    for (Dim_ d = 0; d < my_num_dim; ++d) {
+                        Float_ qval[tile_size], cval[tile_size];
+                        for (size_t i = 0; i < tile_size; ++i) {
+                            qval[i] = qptr[i * my_long_num_dim + d];
+                            cval[i] = cptr[i * my_long_num_dim + d];
+                        }
+                        for (size_t i = 0; i < tile_size; ++i) {
+                            for (size_t j = 0; j < tile_size; ++j) {
+                                acc[i][j] += qval[i] * cval[j];
+                            }
+                        }
+                    }
+
+                    for (size_t i = 0; i < tile_size; ++i) {
+                        for (size_t j = 0; j < tile_size; ++j) {
+                            update<second_>(work, q + i, c + j, my_center_norms[c + j] - 2 * acc[i][j]);
+                        }
+                    }
+                }
+
+                // Mopping up the remaining centers in this chunk.
+                for (; c < chunk_end; ++c) {
+                    const Float_* cptr = my_centers + c * my_long_num_dim;
+                    for (size_t i = 0; i < tile_size; ++i) {
+                        update<second_>(work, q + i, c, my_center_norms[c] - 2 * dot(qptr + i * my_long_num_dim, cptr));
+                    }
+                }
+            }
+
+            // Mopping up the remaining queries.
+            for (size_t q = full_q; q < nq; ++q) {
+                const Float_* qptr = queries + q * my_long_num_dim;
+                for (size_t c = chunk_start; c < chunk_end; ++c) {
+                    update<second_>(work, q, c, my_center_norms[c] - 2 * dot(qptr, my_centers + c * my_long_num_dim));
+                }
+            }
+        }
+    }
+
+    Float_ dot(const Float_* x, const Float_* y) const {
+        Float_ output = 0;
+        for (Dim_ d = 0; d < my_num_dim; ++d) {
+            output += x[d] * y[d];
+        }
+        return output;
+    }
+
+    template<bool second_, typename Count_, class Next_, class Store_>
+    void search_all(Workspace& work, Count_ num, Next_ next, Store_ store) const {
+        Count_ i = 0;
+        while (i < num) {
+            work.num_queries = 0;
+            Count_ block_end = i + static_cast<Count_>(std::min(static_cast<size_t>(num - i), block_size));
+            Count_ block_start = i;
+            for (; i < block_end; ++i) {
+                add(work, next());
+            }
+
+            search<second_>(work);
+            for (Count_ j = block_start; j < block_end; ++j) {
+                auto offset = j - block_start;
+                if constexpr(second_) {
+                    store(j, work.best[offset], work.second[offset]);
+                } else {
+                    store(j, work.best[offset]);
+                }
+            }
+        }
+    }
+
+public:
+    // Finds the closest center for each of 'num' observations, where each
+    // call to 'next()' returns a pointer to the next observation. For the
+    // 'i'-th observation, 'store(i, best)' is called with its closest center.
+    template<typename Count_, class Next_, class Store_>
+    void find(Workspace& work, Count_ num, Next_ next, Store_ store) const {
+        search_all<false>(work, num, std::move(next), std::move(store));
+    }
+
+    // Same as find(), but 'store(i, best, second)' is called with the closest
+    // and second-closest centers. There should be at least two centers.
+    template<typename Count_, class Next_, class Store_>
+    void find2(Workspace& work, Count_ num, Next_ next, Store_ store) const {
+        search_all<true>(work, num, std::move(next), std::move(store));
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef KMEANS_BRUTEFORCESEARCH_HPP
+#define KMEANS_BRUTEFORCESEARCH_HPP
+
+#include <vector>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+namespace kmeans {
+
+namespace internal {
+
+/*
+ * Exhaustive nearest-center search. The centers are interleaved in tiles of
+ * 'tile_size' so that the inner loop computes the squared distances to all
+ * centers in a tile at once with contiguous loads, which is easily
+ * vectorized by the compiler. Each distance is still accumulated across
+ * dimensions in the same order as a naive loop, so the results are exactly
+ * the same as those from QuickSearch (up to the breaking of ties).
+ */
+template<typename Float_, typename Index_, typename Dim_>
+class BruteForceSearch {
+private:
+    static constexpr size_t tile_size = 4;
+
+    Dim_ my_num_dim = 0;
+    size_t my_long_num_dim = 0;
+    Index_ my_num_centers = 0;
+    std::vector<Float_> my_tiles;
+
+public:
+    BruteForceSearch() = default;
+
+    BruteForceSearch(Dim_ ndim, Index_ ncenters, const Float_* centers) {
+        reset(ndim, ncenters, centers);
+    }
+
+    void reset(Dim_ ndim, Index_ ncenters, const Float_* centers) {
+        my_num_dim = ndim;
+        my_long_num_dim = ndim;
+        my_num_centers = ncenters;
+
+        size_t ntiles = (static_cast<size_t>(ncenters) + tile_size - 1) / tile_size;
+        my_tiles.clear();
+        my_tiles.resize(ntiles * tile_size * my_long_num_dim); // padding centers are left as zero and ignored in find().
+
+        for (Index_ c = 0; c < ncenters; ++c) {
+            size_t tile = c / tile_size, offset = c % tile_size;
+            auto tptr = my_tiles.data() + tile * tile_size * my_long_num_dim + offset;
+            auto cptr = centers + static_cast<size_t>(c) * my_long_num_dim; // cast to avoid overflow.
+            for (Dim_ d = 0; d < ndim; ++d, tptr += tile_size) {
+                *tptr = cptr[d];
+            }
+        }
+    }
+
+private:
+    template<bool second_, typename Query_>
+    std::pair<Index_, Index_> search(const Query_* query) const {
+        Index_ best = 0, second = 0;
+        Float_ best_dist = std::numeric_limits<Float_>::max();
+        Float_ second_dist = std::numeric_limits<Float_>::max();
+
+        size_t ncenters = my_num_centers;
+        auto tptr = my_tiles.data();
+        for (size_t start = 0; start < ncenters; start += tile_size, tptr += tile_size * my_long_num_dim) {
+            Float_ acc[tile_size] = {};
+            auto current = tptr;
+            for (Dim_ d = 0; d < my_num_dim; ++d, current += tile_size) {
+                Float_ qval = query[d]; // cast to ensure consistent precision regardless of Query_.
+                for (size_t j = 0; j < tile_size; ++j) {
+                    Float_ delta = current[j] - qval;
+                    acc[j] += delta * delta;
+                }
+            }
+
+            size_t num = std::min(tile_size, ncenters - start);
+            for (size_t j = 0; j < num; ++j) {
+                if (acc[j] < best_dist) {
+                    if constexpr(second_) {
+                        second_dist = best_dist;
+                        second = best;
+                    }
+                    best_dist = acc[j];
+                    best = start + j;
+                } else if constexpr(second_) {
+                    if (acc[j] < second_dist) {
+                        second_dist = acc[j];
+                        second = start + j;
+                    }
+                }
+            }
+        }
+
+        return std::make_pair(best, second);
+    }
+
+public:
+    template<typename Query_>
+    Index_ find(const Query_* query) const {
+        return search<false>(query).first;
+    }
+
+    // There should be at least two centers.
+    template<typename Query_>
+    std::pair<Index_, Index_> find2(const Query_* query) const {
+        return search<true>(query);
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef KMEANS_CENTERSEARCH_HPP
+#define KMEANS_CENTERSEARCH_HPP
+
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "AssignmentStrategy.hpp"
+#include "QuickSearch.hpp"
+#include "BruteForceSearch.hpp"
+#include "BlockedSearch.hpp"
+
+namespace kmeans {
+
+namespace internal {
+
+/*
+ * Crude cost model for choosing between the VP tree and an exhaustive scan.
+ * Each center in the scan costs about 'd + 5' units, where the constant
+ * accounts for the loop overhead. Each node visited in the tree costs about
+ * '4d + 8' units; the tree search uses squared distances with an early exit
+ * on the partial distance, but the per-node branching and lack of
+ * vectorization still make each visit more expensive than a scanned center.
+ * The number of visited nodes grows exponentially with the dimensionality
+ * until it saturates at 'k', at which point the tree is strictly worse. We
+ * also add the cost of building the tree, which matters when there are few
+ * observations. The constants were estimated empirically with isotropic
+ * Gaussian data, where the intrinsic dimensionality is equal to 'd'; real
+ * data with lower intrinsic dimensionality will favor the tree slightly more
+ * than predicted here.
+ */
+template<typename Index_, typename Cluster_, typename Dim_>
+AssignmentStrategy choose_assignment_strategy(Index_ nobs, Cluster_ ncenters, Dim_ ndim) {
+    double n = nobs, k = ncenters, d = ndim;
+    if (k <= 1) {
+        return AssignmentStrategy::BRUTE_FORCE;
+    }
+
+    double depth = std::log2(k);
+    double visited = std::min(k, 4 * depth * std::pow(2.0, d / 1.5));
+    double visit_cost = 4 * d + 8;
+    double tree_cost = k * depth * visit_cost + n * visited * visit_cost;
+    double brute_cost = n * k * (d + 5);
+
+    return (tree_cost < brute_cost ? AssignmentStrategy::VANTAGE_POINT_TREE : AssignmentStrategy::BRUTE_FORCE);
+}
+
+/*
+ * Dispatches nearest-center searches to the implementation for the chosen
+ * AssignmentStrategy. This is constructed once per run() and then reset()
+ * or update()d whenever the centers change; only the chosen implementation is
+ * ever initialized.
+ */
+template<typename Float_, typename Cluster_, typename Dim_>
+class CenterSearch {
+private:
+    static constexpr size_t tree_batch_size = 64;
+
+    AssignmentStrategy my_strategy;
+    int my_num_threads;
+    Dim_ my_num_dim = 0;
+    bool my_initialized = false;
+    QuickSearch<Float_, Cluster_, Dim_> my_tree;
+    BruteForceSearch<Float_, Cluster_, Dim_> my_brute;
+    BlockedSearch<Float_, Cluster_, Dim_> my_blocked;
+
+public:
+    // 'nobs' should be the number of observations to be searched after each reset(), for use in the cost model.
+    template<typename Index_>
+    CenterSearch(AssignmentStrategy strategy, Index_ nobs, Cluster_ ncenters, Dim_ ndim, int nthreads) : my_strategy(strategy), my_num_threads(nthreads) {
+        if (my_strategy == AssignmentStrategy::AUTOMATIC) {
+            my_strategy = choose_assignment_strategy(nobs, ncenters, ndim);
+        }
+    }
+
+    AssignmentStrategy get_strategy() const {
+        return my_strategy;
+    }
+
+    void reset(Dim_ ndim, Cluster_ ncenters, const Float_* centers) {
+        my_num_dim = ndim;
+        switch (my_strategy) {
+            case AssignmentStrategy::BRUTE_FORCE:
+                my_brute.reset(ndim, ncenters, centers);
+                break;
+            case AssignmentStrategy::BLOCKED_DOT_PRODUCT:
+                my_blocked.reset(ndim, ncenters, centers);
+                break;
+            default:
+                my_tree.reset(ndim, ncenters, centers, my_num_threads);
+        }
+        my_initialized = true;
+    }
+
+    // Same as reset(), but the tree is refitted rather than rebuilt if the centers have only moved a little.
+    // The number of centers and dimensions should be the same as in any previous call.
+    void update(Dim_ ndim, Cluster_ ncenters, const Float_* centers) {
+        if (my_initialized && my_strategy == AssignmentStrategy::VANTAGE_POINT_TREE) {
+            my_tree.update(centers, my_num_threads);
+        } else {
+            reset(ndim, ncenters, centers);
+        }
+    }
+
+public:
+    struct Workspace {
+        typename BlockedSearch<Float_, Cluster_, Dim_>::Workspace blocked;
+
+        typename QuickSearch<Float_, Cluster_, Dim_>::BatchWorkspace tree;
+        std::vector<Float_> queries;
+        std::vector<Cluster_> first, second;
+    };
+
+    Workspace create_workspace() const {
+        Workspace output;
+        if (my_strategy == AssignmentStrategy::BLOCKED_DOT_PRODUCT) {
+            output.blocked = my_blocked.create_workspace();
+        } else if (my_strategy == AssignmentStrategy::VANTAGE_POINT_TREE) {
+            output.queries.resize(static_cast<size_t>(my_num_dim) * tree_batch_size); // cast to avoid overflow.
+            output.first.resize(tree_batch_size);
+            output.second.resize(tree_batch_size);
+        }
+        return output;
+    }
+
+private:
+    template<bool second_, typename Count_, class Next_, class Store_>
+    void search_all(Workspace& work, Count_ num, Next_ next, Store_ store) const {
+        if (my_strategy == AssignmentStrategy::BLOCKED_DOT_PRODUCT) {
+            if constexpr(second_) {
+                my_blocked.find2(work.blocked, num, std::move(next), std::move(store));
+            } else {
+                my_blocked.find(work.blocked, num, std::move(next), std::move(store));
+            }
+            return;
+        }
+
+        if (my_strategy == AssignmentStrategy::VANTAGE_POINT_TREE) {
+            // Copying each block of observations into a contiguous buffer for a batched search,
+            // as the pointers from next() are not guaranteed to remain valid across calls.
+            size_t long_num_dim = my_num_dim;
+            Count_ i = 0;
+            while (i < num) {
+                Count_ block_start = i;
+                Count_ block_end = i + static_cast<Count_>(std::min(static_cast<size_t>(num - i), tree_batch_size));
+                auto qptr = work.queries.data();
+                for (; i < block_end; ++i, qptr += long_num_dim) {
+                    std::copy_n(next(), long_num_dim, qptr);
+                }
+
+                size_t block_size = block_end - block_start;
+                if constexpr(second_) {
+                    my_tree.find2_batch(block_size, work.queries.data(), work.first.data(), work.second.data(), work.tree);
+                    for (size_t b = 0; b < block_size; ++b) {
+                        store(block_start + b, work.first[b], work.second[b]);
+                    }
+                } else {
+                    my_tree.find_batch(block_size, work.queries.data(), work.first.data(), work.tree);
+                    for (size_t b = 0; b < block_size; ++b) {
+                        store(block_start + b, work.first[b]);
+                    }
+                }
+            }
+            return;
+        }
+
+        for (Count_ i = 0; i < num; ++i) {
+            auto ptr = next();
+            if constexpr(second_) {
+                auto res = my_brute.find2(ptr);
+                store(i, res.first, res.second);
+            } else {
+                store(i, my_brute.find(ptr));
+            }
+        }
+    }
+
+public:
+    // Finds the closest center for each of 'num' observations, where each
+    // call to 'next()' returns a pointer to the next observation. For the
+    // 'i'-th observation, 'store(i, best)' is called with its closest center.
+    template<typename Count_, class Next_, class Store_>
+    void find(Workspace& work, Count_ num, Next_ next, Store_ store) const {
+        search_all<false>(work, num, std::move(next), std::move(store));
+    }
+
+    // Same as find(), but 'store(i, best, second)' is called with the closest
+    // and second-closest centers. There should be at least two centers.
+    template<typename Count_, class Next_, class Store_>
+    void find2(Workspace& work, Count_ num, Next_ next, Store_ store) const {
+        search_all<true>(work, num, std::move(next), std::move(store));
+    }
+};
+
+}
+
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <vector>
 
+#include "AssignmentStrategy.hpp"
+
 /**
  * @file Details.hpp
  *
@@ -48,6 +50,20 @@ struct Details {
      * The interpretation of a non-zero value depends on the algorithm.
      */
     int status = 0;
+
+    /**
+     * The strategy used to assign observations to their closest centers, for refinement algorithms that accept an `AssignmentStrategy` option.
+     * If `AssignmentStrategy::AUTOMATIC` was requested, this reports the strategy that was actually chosen.
+     * For other algorithms (or when the input is an edge case that does not require any search), this is left as `AssignmentStrategy::AUTOMATIC`.
+     */
+    AssignmentStrategy assignment_strategy = AssignmentStrategy::AUTOMATIC;
+
+    /**
+     * The maximum absolute difference between the incrementally updated and recomputed coordinates of any centroid,
+     * across all recomputations in `RefineHartiganWong` when `RefineHartiganWongOptions::report_centroid_drift = true`.
+     * For other algorithms (or if the drift was not measured), this is left as zero.
+     */
+    double max_centroid_drift = 0;
 };
 
 }
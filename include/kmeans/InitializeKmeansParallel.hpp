@@ -0,0 +1,316 @@
+#ifndef KMEANS_INITIALIZE_KMEANS_PARALLEL_HPP
+#define KMEANS_INITIALIZE_KMEANS_PARALLEL_HPP
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+#include "aarand/aarand.hpp"
+
+#include "Initialize.hpp"
+#include "InitializeKmeanspp.hpp"
+#include "SimpleMatrix.hpp"
+#include "copy_into_array.hpp"
+#include "parallelize.hpp"
+
+/**
+ * @file InitializeKmeansParallel.hpp
+ *
+ * @brief Class for **k-means||** initialization.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for **k-means||** initialization.
+ */
+struct InitializeKmeansParallelOptions {
+    /**
+     * Oversampling factor \f$\ell\f$, defining the expected number of candidates to sample in each round as a multiple of the number of centers.
+     * This should be positive; if not, no candidates are sampled in the regular rounds, and only the additional rounds (see `InitializeKmeansParallelOptions::num_rounds`) are performed.
+     */
+    double oversampling_factor = 2;
+
+    /**
+     * Number of sampling rounds.
+     * Each round is followed by a pass over the dataset to compute distances to the new candidates, so the total number of passes is one more than the number of rounds.
+     * Additional rounds are performed if the number of distinct candidates is less than the number of centers, as long as there are observations that are not identical to an existing candidate.
+     * In each additional round, the expected number of new candidates is at least the number of missing candidates, regardless of `InitializeKmeansParallelOptions::oversampling_factor`.
+     */
+    int num_rounds = 5;
+
+    /**
+     * Random seed to use to construct the PRNG prior to sampling.
+     */
+    uint64_t seed = 6523u;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace InitializeKmeansParallel_internal {
+
+template<typename Float_, typename Index_>
+struct Candidates {
+    std::vector<Index_> ids;
+    std::vector<Float_> coordinates; // column-major, one column per candidate.
+    std::vector<Index_> weights;
+};
+
+template<typename Float_, class Matrix_>
+Candidates<Float_, typename Matrix_::index_type> sample_candidates(const Matrix_& data, double expected, int nrounds, size_t ncenters, uint64_t seed, int nthreads) {
+    typedef typename Matrix_::index_type Index_;
+    typedef typename Matrix_::dimension_type Dim_;
+
+    auto nobs = data.num_observations();
+    auto ndim = data.num_dimensions();
+    std::mt19937_64 eng(seed);
+    Candidates<Float_, Index_> output;
+
+    std::vector<Float_> mindist(nobs);
+    std::vector<Index_> closest(nobs);
+    std::vector<Index_> latest;
+    {
+        auto first = static_cast<Index_>(aarand::standard_uniform<double>(eng) * static_cast<double>(nobs));
+        latest.push_back(std::min(first, static_cast<Index_>(nobs - 1)));
+    }
+
+    auto work = data.create_workspace();
+    for (int round = 0; ; ++round) {
+        // Storing the coordinates of the latest candidates so that the
+        // threads don't need to fetch them from 'data' for each observation.
+        Index_ old_ncandidates = output.ids.size();
+        Index_ new_ncandidates = old_ncandidates + latest.size();
+        output.ids.insert(output.ids.end(), latest.begin(), latest.end());
+        output.coordinates.resize(static_cast<size_t>(new_ncandidates) * static_cast<size_t>(ndim)); // cast to avoid overflow.
+        for (Index_ c = old_ncandidates; c < new_ncandidates; ++c) {
+            auto ptr = data.get_observation(output.ids[c], work);
+            std::copy_n(ptr, ndim, output.coordinates.begin() + static_cast<size_t>(c) * static_cast<size_t>(ndim)); // cast to avoid overflow.
+        }
+
+        parallelize(nthreads, nobs, [&](int, Index_ start, Index_ length) {
+            auto curwork = data.create_workspace();
+            for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                if (round && mindist[obs] == 0) {
+                    continue;
+                }
+
+                auto optr = data.get_observation(obs, curwork);
+                for (Index_ c = old_ncandidates; c < new_ncandidates; ++c) {
+                    auto acopy = optr;
+                    auto ccopy = output.coordinates.data() + static_cast<size_t>(c) * static_cast<size_t>(ndim); // cast to avoid overflow.
+
+                    Float_ r2 = 0;
+                    for (Dim_ dim = 0; dim < ndim; ++dim, ++acopy, ++ccopy) {
+                        Float_ delta = static_cast<Float_>(*acopy) - *ccopy; // cast to ensure consistent precision regardless of Data_.
+                        r2 += delta * delta;
+                    }
+
+                    if (c == 0 || r2 < mindist[obs]) {
+                        mindist[obs] = r2;
+                        closest[obs] = c;
+                    }
+                }
+            }
+        });
+
+        // Candidates that are identical to another candidate from the same round
+        // will not be the closest candidate to any observation, including themselves.
+        size_t ndistinct = 0;
+        for (Index_ c = 0; c < new_ncandidates; ++c) {
+            ndistinct += (closest[output.ids[c]] == c);
+        }
+
+        Float_ total = 0;
+        for (Index_ obs = 0; obs < nobs; ++obs) {
+            total += mindist[obs];
+        }
+
+        if (total == 0) { // a.k.a. only duplicates left.
+            break;
+        }
+        // 'round' is the number of sampling rounds performed so far, so we
+        // only stop once we've computed distances to the last round's candidates.
+        if (round >= nrounds && ndistinct >= ncenters) {
+            break;
+        }
+
+        // Sampling each observation independently. This is done serially so
+        // that the results do not depend on the number of threads.
+        // In any additional rounds, we make sure to sample enough candidates
+        // to make progress, even if 'expected' is too small (or non-positive).
+        latest.clear();
+        Float_ round_expected = expected;
+        if (round >= nrounds) {
+            round_expected = std::max(round_expected, static_cast<Float_>(ncenters - ndistinct));
+        }
+        const Float_ multiplier = round_expected / total;
+        for (Index_ obs = 0; obs < nobs; ++obs) {
+            if (mindist[obs]) {
+                Float_ prob = mindist[obs] * multiplier;
+                if (prob >= 1 || aarand::standard_uniform<Float_>(eng) < prob) {
+                    latest.push_back(obs);
+                }
+            }
+        }
+    }
+
+    output.weights.resize(output.ids.size());
+    for (Index_ obs = 0; obs < nobs; ++obs) {
+        ++output.weights[closest[obs]];
+    }
+
+    return output;
+}
+
+template<typename Float_, typename Index_, typename Dim_, typename Cluster_>
+std::vector<Index_> reduce_candidates(const Candidates<Float_, Index_>& candidates, Dim_ ndim, Cluster_ ncenters, uint64_t seed, int nthreads) {
+    Index_ ncandidates = candidates.ids.size();
+    std::vector<Float_> mindist(ncandidates, 1);
+    std::vector<Float_> weighted(ncandidates);
+    std::vector<Float_> cumulative(ncandidates);
+    std::vector<Index_> sofar;
+    sofar.reserve(ncenters);
+    std::mt19937_64 eng(seed);
+
+    for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+        if (!sofar.empty()) {
+            auto last_ptr = candidates.coordinates.data() + static_cast<size_t>(sofar.back()) * static_cast<size_t>(ndim); // cast to avoid overflow.
+
+            parallelize(nthreads, ncandidates, [&](int, Index_ start, Index_ length) {
+                for (Index_ c = start, end = start + length; c < end; ++c) {
+                    if (mindist[c]) {
+                        auto acopy = candidates.coordinates.data() + static_cast<size_t>(c) * static_cast<size_t>(ndim); // cast to avoid overflow.
+                        auto scopy = last_ptr;
+
+                        Float_ r2 = 0;
+                        for (Dim_ dim = 0; dim < ndim; ++dim, ++acopy, ++scopy) {
+                            Float_ delta = *acopy - *scopy;
+                            r2 += delta * delta;
+                        }
+
+                        if (cen == 1 || r2 < mindist[c]) {
+                            mindist[c] = r2;
+                        }
+                    }
+                }
+            });
+        }
+
+        for (Index_ c = 0; c < ncandidates; ++c) {
+            weighted[c] = mindist[c] * static_cast<Float_>(candidates.weights[c]);
+        }
+        cumulative[0] = weighted[0];
+        for (Index_ c = 1; c < ncandidates; ++c) {
+            cumulative[c] = cumulative[c-1] + weighted[c];
+        }
+
+        const auto total = cumulative.back();
+        if (total == 0) { // a.k.a. only duplicates left.
+            break;
+        }
+
+        auto chosen_id = InitializeKmeanspp_internal::weighted_sample(cumulative, weighted, ncandidates, eng);
+        mindist[chosen_id] = 0;
+        sofar.push_back(chosen_id);
+    }
+
+    for (auto& s : sofar) {
+        s = candidates.ids[s];
+    }
+    return sofar;
+}
+
+template<typename Float_, class Matrix_, typename Cluster_>
+std::vector<typename Matrix_::index_type> run_kmeans_parallel(const Matrix_& data, Cluster_ ncenters, const InitializeKmeansParallelOptions& options) {
+    auto candidates = sample_candidates<Float_>(
+        data,
+        options.oversampling_factor * static_cast<double>(ncenters),
+        options.num_rounds,
+        ncenters,
+        options.seed,
+        options.num_threads
+    );
+
+    // Using a different stream for the reduction, so that it is not affected by the number of draws during sampling.
+    return reduce_candidates(candidates, data.num_dimensions(), ncenters, options.seed + 1, options.num_threads);
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief **k-means||** initialization of Bahmani et al. (2012).
+ *
+ * This is a scalable variant of **k-means++** (see `InitializeKmeanspp`) that avoids one pass over the dataset for each chosen center.
+ * We start with a single candidate that is randomly chosen from all observations.
+ * In each round, each observation is independently sampled as a new candidate with probability proportional to its squared distance to the closest existing candidate,
+ * such that the expected number of new candidates is equal to \f$\ell k\f$ for oversampling factor \f$\ell\f$ and \f$k\f$ centers.
+ * The distances are then updated for the new candidates, which is parallelized across observations.
+ * After a few rounds, each candidate is weighted by the number of observations for which it is the closest candidate,
+ * and the candidates are reduced to \f$k\f$ centers by weighted **k-means++**.
+ *
+ * The sampling in each round is performed serially so that the chosen centers are the same for any number of threads.
+ * As the number of rounds is typically much less than \f$k\f$, this requires far fewer passes over the dataset than **k-means++**,
+ * at the cost of oversampling more candidates than are needed in each pass.
+ *
+ * @tparam Matrix_ Matrix type for the input data.
+ * This should satisfy the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centroids.
+ *
+ * @see
+ * Bahmani, B., Moseley, B., Vattani, A., Kumar, R. and Vassilvitskii, S. (2012).
+ * Scalable k-means++.
+ * _Proceedings of the VLDB Endowment_ 5, 622-633.
+ */
+template<typename Matrix_ = SimpleMatrix<double, int>, typename Cluster_ = int, typename Float_ = double>
+class InitializeKmeansParallel : public Initialize<Matrix_, Cluster_, Float_> {
+private:
+    InitializeKmeansParallelOptions my_options;
+
+public:
+    /**
+     * @param options Options for **k-means||** initialization.
+     */
+    InitializeKmeansParallel(InitializeKmeansParallelOptions options) : my_options(std::move(options)) {}
+
+    /**
+     * Default constructor.
+     */
+    InitializeKmeansParallel() = default;
+
+public:
+    /**
+     * @return Options for **k-means||** initialization,
+     * to be modified prior to calling `run()`.
+     */
+    InitializeKmeansParallelOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    Cluster_ run(const Matrix_& matrix, Cluster_ ncenters, Float_* centers) const {
+        size_t nobs = matrix.num_observations();
+        if (!nobs || ncenters <= 0) {
+            return 0;
+        }
+
+        auto sofar = InitializeKmeansParallel_internal::run_kmeans_parallel<Float_>(matrix, ncenters, my_options);
+        internal::copy_into_array(matrix, sofar, centers);
+        return sofar.size();
+    }
+};
+
+}
+
+#endif
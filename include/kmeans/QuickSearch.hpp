@@ -5,8 +5,11 @@
 #include <random>
 #include <limits>
 #include <cmath>
-#include <queue>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "parallelize.hpp"
 
 namespace kmeans {
 
@@ -29,6 +32,31 @@ private:
         return output;
     }
 
+    /*
+     * Partial distance calculation that may stop early once the squared
+     * distance exceeds 'cutoff', in which case a value greater than 'cutoff'
+     * is returned. Otherwise, the full squared distance is returned, and is
+     * exactly equal to that from raw_distance() as the summation order is the
+     * same. We only check every few dimensions to avoid a branch per term.
+     */
+    static constexpr Dim_ partial_check_interval = 8;
+
+    template<typename Query_>
+    static Float_ raw_distance(const Float_* x, const Query_* y, Dim_ ndim, Float_ cutoff) {
+        Float_ output = 0;
+        Dim_ i = 0;
+        while (true) {
+            Dim_ end = (ndim - i > partial_check_interval ? i + partial_check_interval : ndim);
+            for (; i < end; ++i, ++x, ++y) {
+                Float_ delta = *x - static_cast<Float_>(*y); // cast to ensure consistent precision regardless of Query_.
+                output += delta * delta;
+            }
+            if (i == ndim || output > cutoff) {
+                return output;
+            }
+        }
+    }
+
 private:
     typedef std::pair<Float_, Index_> DataPoint;
     std::vector<DataPoint> items;
@@ -37,98 +65,266 @@ private:
     // Index_ might be unsigned, so we use zero as the LEAF marker.
     static const Index_ LEAF = 0;
 
+    // No default member initializers here, so that Node is trivially copyable
+    // into the arena. Value-initialization (e.g., by emplace_back()) will still
+    // zero all members, i.e., 'left' and 'right' default to LEAF.
     struct Node {
-        const Float_* center = NULL;
-        Float_ radius = 0;
+        // Squared distance from the vantage point to the median point when the tree was built.
+        Float_ squared_radius;
+
+        // Upper bound on the distance from the vantage point to any point in the left subtree,
+        // and lower bound on the distance to any point in the right subtree. These are equal
+        // to sqrt('squared_radius') after the tree is built, and are loosened by update() as the points move.
+        Float_ left_radius;
+        Float_ right_radius;
 
         // Original index of current vantage point
-        Index_ index = 0;
+        Index_ index;
 
         // Node index of the next vantage point for all children closer than 'threshold' from the current vantage point.
         // This must be > 0, as the first node in 'nodes' is the root and cannot be referenced from other nodes.
-        Index_ left = LEAF;
+        Index_ left;
 
         // Node index of the next vantage point for all children further than 'threshold' from the current vantage point.
         // This must be > 0, as the first node in 'nodes' is the root and cannot be referenced from other nodes.
-        Index_ right = LEAF;
+        Index_ right;
     };
 
     std::vector<Node> nodes;
 
-private:
-    template<class Engine_>
-    Index_ build(Index_ lower, Index_ upper, const Float_* coords, Engine_& rng) {
-        /*
-         * We're assuming that lower < upper at each point within this
-         * recursion. This requires some protection at the call site
-         * when nobs = 0, see the reset() function.
-         */
+    /*
+     * After construction, the nodes are flattened into a single arena in
+     * breadth-first order. Each record consists of the Node itself, followed
+     * by the coordinates of its vantage point, so a visit to a node only
+     * touches one contiguous stretch of memory. Breadth-first ordering also
+     * ensures that the top levels of the tree, which are visited by every
+     * search, are packed together at the start of the arena.
+     *
+     * We use memcpy to get the Node in and out of the Float_ storage, which
+     * avoids aliasing issues and should be optimized into plain loads.
+     */
+    size_t header_size = 0;
+    size_t record_size = 0;
+    std::vector<Float_> arena;
+
+    Node get_node(Index_ i) const {
+        Node output;
+        std::memcpy(&output, arena.data() + static_cast<size_t>(i) * record_size, sizeof(Node)); // cast to avoid overflow.
+        return output;
+    }
+
+    void set_node(Index_ i, const Node& node) {
+        std::memcpy(arena.data() + static_cast<size_t>(i) * record_size, &node, sizeof(Node)); // cast to avoid overflow.
+    }
 
-        Index_ pos = nodes.size();
-        nodes.emplace_back();
-        Node& node = nodes.back(); // this is safe during recursion because we reserved 'nodes' already to the number of observations, see reset().
+    const Float_* get_center(Index_ i) const {
+        return arena.data() + static_cast<size_t>(i) * record_size + header_size; // cast to avoid overflow.
+    }
+
+    Float_* get_center(Index_ i) {
+        return arena.data() + static_cast<size_t>(i) * record_size + header_size; // cast to avoid overflow.
+    }
 
+private:
+    /*
+     * Sets up the node for the interval [lower, upper) of 'items', which is
+     * always stored at position 'lower' in 'nodes'. This is because the nodes
+     * are laid out in pre-order, where each node is followed by its left
+     * subtree (i.e., [lower + 1, median)) and then its right subtree (i.e.,
+     * [median, upper)). As such, different subtrees can be built in parallel
+     * as they touch disjoint parts of 'items' and 'nodes'.
+     *
+     * We're assuming that lower < upper at each point, which requires some
+     * protection at the call site when nobs = 0, see the reset() function.
+     * The median is returned for internal nodes, otherwise 'upper' is returned.
+     */
+    template<class Engine_>
+    Index_ split(Index_ lower, Index_ upper, const Float_* coords, Engine_& rng, int nthreads) {
+        Node& node = nodes[lower];
         Index_ gap = upper - lower;
-        if (gap > 1) { // not yet at a leaf.
-
-            /* Choose an arbitrary point and move it to the start of the [lower, upper)
-             * interval in 'items'; this is our new vantage point.
-             *
-             * Yes, I know that the modulo method does not provide strictly
-             * uniform values but statistical correctness doesn't really matter
-             * here, and I don't want std::uniform_int_distribution's
-             * implementation-specific behavior.
-             */
-            Index_ i = (rng() % gap + lower);
-            std::swap(items[lower], items[i]);
-            const auto& vantage = items[lower];
-            node.index = vantage.second;
-            const Float_* vantage_ptr = coords + static_cast<size_t>(vantage.second) * long_num_dim; // cast to avoid overflow.
-            node.center = vantage_ptr;
-
-            // Compute distances to the new vantage point.
-            for (Index_ i = lower + 1; i < upper; ++i) {
+        if (gap == 1) {
+            node.index = items[lower].second;
+            return upper;
+        }
+
+        /* Choose an arbitrary point and move it to the start of the [lower, upper)
+         * interval in 'items'; this is our new vantage point.
+         *
+         * Yes, I know that the modulo method does not provide strictly
+         * uniform values but statistical correctness doesn't really matter
+         * here, and I don't want std::uniform_int_distribution's
+         * implementation-specific behavior.
+         */
+        Index_ i = (rng() % gap + lower);
+        std::swap(items[lower], items[i]);
+        const auto& vantage = items[lower];
+        node.index = vantage.second;
+        const Float_* vantage_ptr = coords + static_cast<size_t>(vantage.second) * long_num_dim; // cast to avoid overflow.
+
+        // Compute distances to the new vantage point.
+        Index_ lower_p1 = lower + 1; // excluding the vantage point itself, obviously.
+        auto compute = [&](Index_ start, Index_ end) -> void {
+            for (Index_ i = start; i < end; ++i) {
                 const Float_* loc = coords + static_cast<size_t>(items[i].second) * long_num_dim; // cast to avoid overflow.
                 items[i].first = raw_distance(vantage_ptr, loc, num_dim);
             }
+        };
+        if (nthreads > 1) {
+            parallelize(nthreads, upper - lower_p1, [&](int, Index_ start, Index_ length) -> void {
+                compute(lower_p1 + start, lower_p1 + start + length);
+            });
+        } else {
+            compute(lower_p1, upper);
+        }
+
+        // Partition around the median distance from the vantage point.
+        Index_ median = lower + gap/2;
+        std::nth_element(items.begin() + lower_p1, items.begin() + median, items.begin() + upper);
+
+        // Radius of the new node will be the distance to the median.
+        node.squared_radius = items[median].first;
+        node.left_radius = std::sqrt(node.squared_radius);
+        node.right_radius = node.left_radius;
+
+        if (lower_p1 < median) {
+            node.left = lower_p1;
+        }
+        node.right = median; // median < upper is always true here.
+        return median;
+    }
+
+    template<class Engine_>
+    void build(Index_ lower, Index_ upper, const Float_* coords, Engine_& rng) {
+        Index_ median = split(lower, upper, coords, rng, 1);
+        if (lower + 1 < median) {
+            build(lower + 1, median, coords, rng);
+        }
+        if (median < upper) {
+            build(median, upper, coords, rng);
+        }
+    }
 
-            // Partition around the median distance from the vantage point.
-            Index_ median = lower + gap/2;
-            Index_ lower_p1 = lower + 1; // excluding the vantage point itself, obviously.
-            std::nth_element(items.begin() + lower_p1, items.begin() + median, items.begin() + upper);
+    // Number of random draws used by build() for an interval of length 'gap', i.e., the number of internal nodes.
+    static uint64_t count_draws(Index_ gap) {
+        if (gap <= 1) {
+            return 0;
+        }
+        Index_ half = gap / 2;
+        return 1 + count_draws(half - 1) + count_draws(gap - half);
+    }
 
-            // Radius of the new node will be the distance to the median.
-            node.radius = std::sqrt(items[median].first);
+    /*
+     * For parallel construction, we serially set up the top few levels of the
+     * tree (parallelizing the distance calculations within each node) until
+     * there are enough independent subtrees, and then we build the subtrees in
+     * parallel. The random number stream for each subtree is obtained by
+     * advancing the parent's stream past the draws that would have been made
+     * by the serial build() for the preceding subtrees. This ensures that we
+     * get exactly the same tree as the serial build, regardless of the number
+     * of threads.
+     */
+    template<class Engine_>
+    void build_parallel(Index_ nobs, const Float_* coords, Engine_& rng, int nthreads) {
+        struct Task {
+            Index_ lower, upper;
+            Engine_ rng;
+        };
+        std::vector<Task> tasks, next;
+        tasks.push_back(Task{ 0, nobs, rng });
+
+        size_t target = static_cast<size_t>(nthreads) * 4;
+        while (tasks.size() < target) {
+            next.clear();
+            bool expanded = false;
+
+            for (auto& t : tasks) {
+                if (t.upper - t.lower == 1) {
+                    next.push_back(std::move(t));
+                    continue;
+                }
+
+                Index_ median = split(t.lower, t.upper, coords, t.rng, nthreads);
+                expanded = true;
+
+                Index_ lower_p1 = t.lower + 1;
+                Engine_ right_rng = t.rng;
+                right_rng.discard(count_draws(median - lower_p1));
+                if (lower_p1 < median) {
+                    next.push_back(Task{ lower_p1, median, std::move(t.rng) });
+                }
+                next.push_back(Task{ median, t.upper, std::move(right_rng) });
+            }
 
-            // Recursively build tree.
-            if (lower_p1 < median) {
-                node.left = build(lower_p1, median, coords, rng);
+            tasks.swap(next);
+            if (!expanded) {
+                break;
             }
-            if (median < upper) {
-                node.right = build(median, upper, coords, rng);
+        }
+
+        parallelize(nthreads, tasks.size(), [&](int, size_t start, size_t length) -> void {
+            for (size_t t = start, end = start + length; t < end; ++t) {
+                auto& current = tasks[t];
+                build(current.lower, current.upper, coords, current.rng);
             }
+        });
+    }
 
-        } else {
-            const auto& leaf = items[lower];
-            node.index = leaf.second;
-            node.center = coords + static_cast<size_t>(leaf.second) * long_num_dim; // cast to avoid overflow.
+    void flatten(const Float_* coords, int nthreads) {
+        Index_ nnodes = nodes.size();
+        std::vector<Index_> order;
+        order.reserve(nnodes);
+        order.push_back(0);
+        std::vector<Index_> new_position(nnodes);
+        for (Index_ i = 0; i < nnodes; ++i) {
+            const auto& current = nodes[order[i]];
+            new_position[order[i]] = i;
+            if (current.left != LEAF) {
+                order.push_back(current.left);
+            }
+            if (current.right != LEAF) {
+                order.push_back(current.right);
+            }
         }
 
-        return pos;
+        header_size = (sizeof(Node) + sizeof(Float_) - 1) / sizeof(Float_);
+        record_size = header_size + long_num_dim;
+        arena.resize(record_size * static_cast<size_t>(nnodes)); // cast to avoid overflow.
+
+        parallelize(nthreads, nnodes, [&](int, Index_ start, Index_ length) -> void {
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                auto current = nodes[order[i]];
+                if (current.left != LEAF) {
+                    current.left = new_position[current.left];
+                }
+                if (current.right != LEAF) {
+                    current.right = new_position[current.right];
+                }
+
+                auto record = arena.data() + static_cast<size_t>(i) * record_size; // cast to avoid overflow.
+                std::memcpy(record, &current, sizeof(Node));
+                std::copy_n(coords + static_cast<size_t>(current.index) * long_num_dim, long_num_dim, record + header_size);
+            }
+        });
+
+        nodes.clear();
     }
 
 public:
     QuickSearch() = default;
 
-    QuickSearch(Dim_ ndim, Index_ nobs, const Float_* vals) {
-        reset(ndim, nobs, vals);
+    QuickSearch(Dim_ ndim, Index_ nobs, const Float_* vals, int nthreads = 1) {
+        reset(ndim, nobs, vals, nthreads);
     }
 
-    void reset(Dim_ ndim, Index_ nobs, const Float_* vals) {
+    void reset(Dim_ ndim, Index_ nobs, const Float_* vals, int nthreads = 1) {
         num_dim = ndim;
         long_num_dim = ndim;
+        num_obs = nobs;
         items.clear();
         nodes.clear();
+        arena.clear();
+        reference.clear();
+        rebuild_threshold = 0;
 
         if (nobs) {
             items.reserve(nobs);
@@ -136,7 +332,7 @@ public:
                 items.emplace_back(0, i);
             }
 
-            nodes.reserve(nobs);
+            nodes.resize(nobs); // value-initialized, so all children are LEAF by default.
 
             // Statistical correctness doesn't matter (aside from tie breaking)
             // so we'll just use a deterministically 'random' number to ensure
@@ -145,106 +341,418 @@ public:
             uint64_t base = 1234567890, m1 = nobs, m2 = ndim;
             std::mt19937_64 rand(base * m1 +  m2);
 
-            build(0, nobs, vals, rand);
+            if (nthreads > 1) {
+                build_parallel(nobs, vals, rand, nthreads);
+            } else {
+                build(0, nobs, vals, rand);
+            }
+            flatten(vals, nthreads);
+
+            reference.assign(vals, vals + static_cast<size_t>(nobs) * long_num_dim); // cast to avoid overflow.
+            rebuild_threshold = compute_rebuild_threshold();
         }
     }
 
+private:
+    /*
+     * Once the tree is built, it can be refitted to new coordinates for the
+     * same points by keeping the same topology and loosening the bounds of
+     * each node by the displacement of the points from their coordinates at
+     * construction. Specifically, if the vantage point moves by 'dv' and the
+     * points in its left subtree move by at most 'dl', the triangle inequality
+     * ensures that the distances to the left subtree are no greater than
+     * 'radius + dv + dl'; similarly, the distances to the right subtree are
+     * no less than 'radius - dv - dr'. The search is still exact but prunes
+     * less effectively as the bounds get looser, so we rebuild the tree once
+     * any point has moved by more than a fraction of the typical radius.
+     */
+    Index_ num_obs = 0;
+    std::vector<Float_> reference;
+    Float_ rebuild_threshold = 0;
+    std::vector<Float_> displacement, subtree_displacement;
+
+    static constexpr Float_ rebuild_tolerance = 0.05;
+
+    Float_ compute_rebuild_threshold() const {
+        std::vector<Float_> radii;
+        for (Index_ i = 0; i < num_obs; ++i) {
+            auto node = get_node(i);
+            if (node.left != LEAF || node.right != LEAF) {
+                radii.push_back(node.squared_radius);
+            }
+        }
+        if (radii.empty()) {
+            return 0;
+        }
+        auto mid = radii.begin() + radii.size() / 2;
+        std::nth_element(radii.begin(), mid, radii.end());
+        return std::sqrt(*mid) * rebuild_tolerance;
+    }
+
+public:
+    /*
+     * Updates the tree with new coordinates for the same points, i.e., 'vals'
+     * should have the same dimensions as in the last reset(). This does nothing
+     * if no point has moved, refits the tree if the points have moved a little,
+     * and rebuilds the tree otherwise. Returns true if the tree was rebuilt.
+     */
+    bool update(const Float_* vals, int nthreads = 1) {
+        bool moved = false;
+        for (Index_ i = 0; i < num_obs && !moved; ++i) {
+            auto current = get_center(i);
+            auto replacement = vals + static_cast<size_t>(get_node(i).index) * long_num_dim; // cast to avoid overflow.
+            moved = !std::equal(current, current + long_num_dim, replacement);
+        }
+        if (!moved) {
+            return false;
+        }
+
+        displacement.resize(num_obs);
+        parallelize(nthreads, num_obs, [&](int, Index_ start, Index_ length) -> void {
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                auto offset = static_cast<size_t>(get_node(i).index) * long_num_dim; // cast to avoid overflow.
+                displacement[i] = std::sqrt(raw_distance(reference.data() + offset, vals + offset, num_dim));
+                std::copy_n(vals + offset, long_num_dim, get_center(i));
+            }
+        });
+
+        // Negated comparison so that NaNs also trigger a rebuild.
+        Float_ max_displacement = *std::max_element(displacement.begin(), displacement.end());
+        if (!(max_displacement <= rebuild_threshold)) {
+            reset(num_dim, num_obs, vals, nthreads);
+            return true;
+        }
+
+        // Children always come after their parents in the breadth-first
+        // ordering, so we can compute the maximum displacement in each
+        // subtree by iterating backwards through the arena.
+        subtree_displacement.resize(num_obs);
+        for (Index_ i = num_obs; i > 0; --i) {
+            Index_ j = i - 1;
+            auto node = get_node(j);
+            Float_ left_displacement = (node.left != LEAF ? subtree_displacement[node.left] : 0);
+            Float_ right_displacement = (node.right != LEAF ? subtree_displacement[node.right] : 0);
+            Float_ radius = std::sqrt(node.squared_radius);
+            node.left_radius = radius + displacement[j] + left_displacement;
+            node.right_radius = radius - displacement[j] - right_displacement; // this may be negative, in which case the right subtree is always searched.
+            set_node(j, node);
+            subtree_displacement[j] = std::max(displacement[j], std::max(left_displacement, right_displacement));
+        }
+
+        return false;
+    }
+
 
 private:
+    /*
+     * All searches work with squared distances to avoid a square root at each
+     * node. The current threshold for each query, i.e., the distance to the
+     * furthest of its current closest points, is stored separately and only
+     * needs a square root when the closest points change. The tests on the
+     * (unsquared) bounds are then converted into tests on squared distances:
+     *
+     * - 'dist - threshold <= left_radius' is equivalent to 'dist^2 <= (left_radius + threshold)^2'.
+     * - 'dist + threshold >= right_radius' is always true if 'right_radius - threshold <= 0',
+     *   otherwise it is equivalent to 'dist^2 >= (right_radius - threshold)^2'.
+     */
+    static bool check_left(const Node& node, Float_ dist2, Float_ threshold) {
+        if (node.left == LEAF) {
+            return false;
+        }
+        Float_ bound = node.left_radius + threshold;
+        return dist2 <= bound * bound;
+    }
+
+    static bool check_right(const Node& node, Float_ dist2, Float_ threshold) {
+        if (node.right == LEAF) {
+            return false;
+        }
+        Float_ bound = node.right_radius - threshold;
+        return bound <= 0 || dist2 >= bound * bound;
+    }
+
+    /*
+     * The current closest points for each query are held in a sorted buffer
+     * of fixed capacity, where the distances and indices are stored in
+     * separate arrays so that they can be supplied directly by the caller
+     * of find_k(). Entries are sorted by increasing squared distance, with
+     * ties broken by index; the buffer starts full of placeholders that are
+     * replaced as closer points are found. Each insertion drops the furthest
+     * entry, i.e., the buffer behaves like a bounded priority queue without
+     * any allocations.
+     */
+    struct Neighbors {
+        Float_* distances;
+        Index_* indices;
+        size_t num;
+    };
+
+    static void fill_placeholders(const Neighbors& neighbors) {
+        std::fill_n(neighbors.distances, neighbors.num, std::numeric_limits<Float_>::max());
+        std::fill_n(neighbors.indices, neighbors.num, 0);
+    }
+
+    static Float_ get_largest(const Neighbors& neighbors) {
+        return neighbors.distances[neighbors.num - 1];
+    }
+
+    /*
+     * Once the squared distance to the vantage point exceeds this cutoff, we
+     * know that the vantage point will not be one of the closest points, the
+     * left subtree will be skipped, and the right subtree will be searched.
+     * (The latter follows from 'left_radius >= right_radius'.) Thus, we can
+     * stop computing the distance early without changing the search.
+     */
+    static Float_ get_cutoff(const Node& node, const Neighbors& neighbors, Float_ threshold) {
+        Float_ cutoff = get_largest(neighbors);
+        Float_ bound = 0;
+        if (node.left != LEAF) {
+            bound = node.left_radius + threshold;
+        } else if (node.right != LEAF) {
+            bound = std::max(node.right_radius - threshold, static_cast<Float_>(0));
+        }
+        return std::max(cutoff, bound * bound);
+    }
+
+    // For low dimensions, the partial distance calculation never stops early, so we don't bother computing the cutoff.
     template<typename Query_>
-    void search_nn(Index_ curnode_index, const Query_* target, Index_& closest_point, Float_& closest_dist) const {
-        const auto& curnode=nodes[curnode_index];
-        Float_ dist = std::sqrt(raw_distance(curnode.center, target, num_dim));
-        if (dist < closest_dist) {
-            closest_point = curnode.index;
-            closest_dist = dist;
+    Float_ compute_distance(const Node& node, const Float_* center, const Query_* target, const Neighbors& neighbors, Float_ threshold) const {
+        if (num_dim > partial_check_interval) {
+            return raw_distance(center, target, num_dim, get_cutoff(node, neighbors, threshold));
+        } else {
+            return raw_distance(center, target, num_dim);
         }
+    }
 
-        if (dist < curnode.radius) { // If the target lies within the radius of ball:
-            if (curnode.left != LEAF && dist - closest_dist <= curnode.radius) { // if there can still be neighbors inside the ball, recursively search left child first
-                search_nn(curnode.left, target, closest_point, closest_dist);
-            }
+    static void update_closest(const Neighbors& neighbors, Float_& threshold, Float_ dist2, Index_ index) {
+        auto last = neighbors.num - 1;
+        if (!(dist2 < neighbors.distances[last])) {
+            return;
+        }
 
-            if (curnode.right != LEAF && dist + closest_dist >= curnode.radius) { // if there can still be neighbors outside the ball, recursively search right child
-                search_nn(curnode.right, target, closest_point, closest_dist);
+        auto pos = last;
+        while (pos > 0) {
+            auto prev_dist = neighbors.distances[pos - 1];
+            if (prev_dist < dist2 || (prev_dist == dist2 && neighbors.indices[pos - 1] < index)) {
+                break;
             }
+            neighbors.distances[pos] = prev_dist;
+            neighbors.indices[pos] = neighbors.indices[pos - 1];
+            --pos;
+        }
+        neighbors.distances[pos] = dist2;
+        neighbors.indices[pos] = index;
 
+        threshold = std::sqrt(neighbors.distances[last]);
+    }
+
+    // Recursive search for a single query. This is also used by the batched search once only a few queries are active.
+    template<typename Query_>
+    void search_single(Index_ curnode_index, const Query_* target, const Neighbors& neighbors, Float_& threshold) const {
+        auto curnode = get_node(curnode_index);
+        Float_ dist2 = compute_distance(curnode, get_center(curnode_index), target, neighbors, threshold);
+        update_closest(neighbors, threshold, dist2, curnode.index);
+
+        if (dist2 < curnode.squared_radius) { // If the target lies within the radius of ball:
+            if (check_left(curnode, dist2, threshold)) { // if there can still be neighbors inside the ball, recursively search left child first
+                search_single(curnode.left, target, neighbors, threshold);
+            }
+            if (check_right(curnode, dist2, threshold)) { // if there can still be neighbors outside the ball, recursively search right child
+                search_single(curnode.right, target, neighbors, threshold);
+            }
         } else { // If the target lies outside the radius of the ball:
-            if (curnode.right != LEAF && dist + closest_dist >= curnode.radius) { // if there can still be neighbors outside the ball, recursively search right child first
-                search_nn(curnode.right, target, closest_point, closest_dist);
+            if (check_right(curnode, dist2, threshold)) { // if there can still be neighbors outside the ball, recursively search right child first
+                search_single(curnode.right, target, neighbors, threshold);
             }
-
-            if (curnode.left != LEAF && dist - closest_dist <= curnode.radius) { // if there can still be neighbors inside the ball, recursively search left child
-                search_nn(curnode.left, target, closest_point, closest_dist);
+            if (check_left(curnode, dist2, threshold)) { // if there can still be neighbors inside the ball, recursively search left child
+                search_single(curnode.left, target, neighbors, threshold);
             }
         }
     }
 
+    template<typename Query_>
+    void search_single(const Query_* target, const Neighbors& neighbors) const {
+        fill_placeholders(neighbors);
+        Float_ threshold = std::numeric_limits<Float_>::infinity();
+        search_single(0, target, neighbors, threshold);
+    }
+
 public:
     template<typename Query_>
     Index_ find(const Query_* query) const {
-        Float_ closest_dist = std::numeric_limits<Float_>::max();
-        Index_ closest = 0;
-        search_nn(0, query, closest, closest_dist);
-        return closest;
+        return find_with_distance(query).first;
     }
 
     template<typename Query_>
     std::pair<Index_, Float_> find_with_distance(const Query_* query) const {
-        Float_ closest_dist = std::numeric_limits<Float_>::max();
-        Index_ closest = 0;
-        search_nn(0, query, closest, closest_dist);
-        return std::make_pair(closest, closest_dist);
+        Float_ dist2;
+        Index_ index;
+        search_single(query, Neighbors{ &dist2, &index, 1 });
+        return std::make_pair(index, std::sqrt(dist2));
     }
 
+    template<typename Query_>
+    std::pair<Index_, Index_> find2(const Query_* query) const {
+        // There better be two or more observations in this dataset,
+        // otherwise one of the placeholders will end up being reported!
+        Float_ dist2[2];
+        Index_ indices[2];
+        search_single(query, Neighbors{ dist2, indices, 2 });
+        return std::make_pair(indices[0], indices[1]);
+    }
+
+    /*
+     * Finds the 'm' closest points to 'query', storing their indices and
+     * distances in 'out_indices' and 'out_distances', respectively, in order
+     * of increasing distance. Both arrays should have at least 'm' entries.
+     * If 'm' is greater than the number of points, only the first 'n' entries
+     * are filled for 'n' points. Returns the number of filled entries.
+     */
+    template<typename Query_>
+    Index_ find_k(const Query_* query, Index_ m, Index_* out_indices, Float_* out_distances) const {
+        m = std::min(m, num_obs);
+        if (m == 0) {
+            return 0;
+        }
+
+        search_single(query, Neighbors{ out_distances, out_indices, static_cast<size_t>(m) });
+        for (Index_ i = 0; i < m; ++i) {
+            out_distances[i] = std::sqrt(out_distances[i]);
+        }
+        return m;
+    }
+
+public:
+    /*
+     * Batched searches walk the tree once for a whole block of queries,
+     * where each node is only loaded once and compared against all queries
+     * that are still active at that node. At each node, the active queries are
+     * split into those inside and outside the ball; the former visit the left
+     * child first, and the latter visit the right child first. This ensures
+     * that each query visits the same nodes in the same order as its own
+     * recursive search, so the results are exactly the same as find() and
+     * find2(), including the breaking of ties.
+     */
+    struct BatchWorkspace {
+        // Stack of (query, squared distance to the current vantage point) for the active queries at each level of the tree.
+        std::vector<std::pair<size_t, Float_> > active;
+
+        // Buffers of the current closest points for each query, one per query for find_batch() and two per query for find2_batch().
+        std::vector<Float_> distances;
+        std::vector<Index_> indices;
+
+        // Current threshold for each query.
+        std::vector<Float_> thresholds;
+    };
+
 private:
+    // Once only a few queries are active, the bookkeeping for the batch
+    // costs more than it saves, so we switch to searching each query separately.
+    static constexpr size_t batch_fallback = 16;
+
+    static Neighbors get_neighbors(BatchWorkspace& work, size_t q, size_t m) {
+        return Neighbors{ work.distances.data() + q * m, work.indices.data() + q * m, m };
+    }
+
     template<typename Query_>
-    void search_nn(Index_ curnode_index, const Query_* target, std::priority_queue<std::pair<Float_, Index_> >& closest) const {
-        const auto& curnode=nodes[curnode_index];
-        Float_ dist = std::sqrt(raw_distance(curnode.center, target, num_dim));
+    void search_batch(Index_ curnode_index, size_t start, size_t end, const Query_* queries, size_t m, BatchWorkspace& work) const {
+        auto& active = work.active;
+        if (end - start <= batch_fallback) {
+            for (size_t a = start; a < end; ++a) {
+                auto q = active[a].first;
+                search_single(curnode_index, queries + q * long_num_dim, get_neighbors(work, q, m), work.thresholds[q]);
+            }
+            return;
+        }
 
-        auto biggest_dist = closest.top().first;
-        if (dist < biggest_dist) {
-            closest.pop();
-            closest.emplace(dist, curnode.index);
-            biggest_dist = closest.top().first;
+        auto curnode = get_node(curnode_index);
+        auto center = get_center(curnode_index);
+        for (size_t a = start; a < end; ++a) {
+            auto q = active[a].first;
+            auto neighbors = get_neighbors(work, q, m);
+            auto& threshold = work.thresholds[q];
+            Float_ dist2 = compute_distance(curnode, center, queries + q * long_num_dim, neighbors, threshold);
+            active[a].second = dist2;
+            update_closest(neighbors, threshold, dist2, curnode.index);
         }
 
-        if (dist < curnode.radius) { // If the target lies within the radius of ball:
-            if (curnode.left != LEAF && dist - biggest_dist <= curnode.radius) { // if there can still be neighbors inside the ball, recursively search left child first
-                search_nn(curnode.left, target, closest);
+        if (curnode.left == LEAF && curnode.right == LEAF) {
+            return;
+        }
+
+        // Partitioning the active queries into those inside the ball, which
+        // are moved to [start, mid), and those outside, in [mid, end).
+        size_t mid = start;
+        for (size_t a = start; a < end; ++a) {
+            if (active[a].second < curnode.squared_radius) {
+                std::swap(active[a], active[mid]);
+                ++mid;
             }
+        }
 
-            if (curnode.right != LEAF && dist + biggest_dist >= curnode.radius) { // if there can still be neighbors outside the ball, recursively search right child
-                search_nn(curnode.right, target, closest);
+        // Each pass collects the queries that satisfy the relevant conditions
+        // into a new segment at the end of 'active', and recurses into the
+        // child with that segment. Note that we always use indices into
+        // 'active' as emplace_back() may invalidate any pointers.
+        auto recurse = [&](Index_ child, size_t from, size_t to, bool left) -> void {
+            if (child == LEAF || from == to) {
+                return;
             }
 
-        } else { // If the target lies outside the radius of the ball:
-            if (curnode.right != LEAF && dist + biggest_dist >= curnode.radius) { // if there can still be neighbors outside the ball, recursively search right child first
-                search_nn(curnode.right, target, closest);
+            size_t mark = active.size();
+            for (size_t a = from; a < to; ++a) {
+                auto q = active[a].first;
+                auto dist2 = active[a].second;
+                auto threshold = work.thresholds[q];
+                if (left ? check_left(curnode, dist2, threshold) : check_right(curnode, dist2, threshold)) {
+                    active.emplace_back(q, 0);
+                }
             }
 
-            if (curnode.left != LEAF && dist - biggest_dist <= curnode.radius) { // if there can still be neighbors inside the ball, recursively search left child
-                search_nn(curnode.left, target, closest);
+            if (active.size() > mark) {
+                search_batch(child, mark, active.size(), queries, m, work);
+                active.resize(mark);
             }
+        };
+
+        recurse(curnode.left, start, mid, /* left = */ true);
+        recurse(curnode.right, mid, end, /* left = */ false);
+        recurse(curnode.right, start, mid, /* left = */ false);
+        recurse(curnode.left, mid, end, /* left = */ true);
+    }
+
+    template<typename Query_>
+    void search_batch(size_t num, const Query_* queries, size_t m, BatchWorkspace& work) const {
+        work.distances.resize(num * m);
+        work.indices.resize(num * m);
+        fill_placeholders(Neighbors{ work.distances.data(), work.indices.data(), num * m });
+        work.thresholds.clear();
+        work.thresholds.resize(num, std::numeric_limits<Float_>::infinity());
+        work.active.clear();
+        for (size_t q = 0; q < num; ++q) {
+            work.active.emplace_back(q, 0);
         }
+        search_batch(0, 0, num, queries, m, work);
     }
 
 public:
+    // 'queries' should contain the coordinates of 'num' observations, stored contiguously.
+    // On return, 'output' is filled with the closest point for each query.
     template<typename Query_>
-    std::pair<Index_, Index_> find2(const Query_* query) const {
-        // There better be two or more observations in this dataset,
-        // otherwise one of the placeholders will end up being reported!
-        std::priority_queue<std::pair<Float_, Index_> > closest;
-        closest.emplace(std::numeric_limits<Float_>::max(), 0);
-        closest.emplace(std::numeric_limits<Float_>::max(), 0);
-        search_nn(0, query, closest);
-
-        std::pair<Index_, Index_> output;
-        output.second = closest.top().second;
-        closest.pop();
-        output.first = closest.top().second;
-        return output;
+    void find_batch(size_t num, const Query_* queries, Index_* output, BatchWorkspace& work) const {
+        search_batch(num, queries, 1, work);
+        std::copy_n(work.indices.begin(), num, output);
+    }
+
+    // Same as find_batch(), but the closest and second-closest points are stored in 'first' and 'second', respectively.
+    // There should be at least two points in the tree.
+    template<typename Query_>
+    void find2_batch(size_t num, const Query_* queries, Index_* first, Index_* second, BatchWorkspace& work) const {
+        search_batch(num, queries, 2, work);
+        for (size_t q = 0; q < num; ++q) {
+            first[q] = work.indices[2 * q];
+            second[q] = work.indices[2 * q + 1];
+        }
     }
 };
 
@@ -0,0 +1,228 @@
+#ifndef KMEANS_REFINE_ELKAN_HPP
+#define KMEANS_REFINE_ELKAN_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "Refine.hpp"
+#include "Details.hpp"
+#include "is_edge_case.hpp"
+#include "compute_centroids.hpp"
+#include "compute_distances.hpp"
+#include "parallelize.hpp"
+
+/**
+ * @file RefineElkan.hpp
+ *
+ * @brief Implements Elkan's accelerated Lloyd algorithm for k-means clustering.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for `RefineElkan` construction.
+ */
+struct RefineElkanOptions {
+    /**
+     * Maximum number of iterations.
+     * More iterations increase the opportunity for convergence at the cost of more computational time.
+     */
+    int max_iterations = 10;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Implements Elkan's accelerated Lloyd algorithm for k-means clustering.
+ *
+ * Elkan's algorithm produces the same batch assignments and center calculations as `RefineLloyd`,
+ * (up to the breaking of ties between equidistant centers) but uses the triangle inequality to skip most of the distance calculations between observations and centers.
+ * For each observation, we store an upper bound on the distance to its assigned center and a lower bound on the distance to every other center.
+ * These bounds are adjusted by the distance that each center moves in each iteration.
+ * An observation is only compared to a center if the bounds (or half the distance between that center and the currently assigned center) indicate that the center might be closer.
+ * This is most effective in later iterations where the centers do not move much.
+ *
+ * The cost of this approach is the storage of the lower bounds, which requires an array of length equal to the product of the number of observations and centers.
+ * Users with many observations and centers may prefer `RefineHamerly`, which only stores a single lower bound per observation.
+ *
+ * In the `Details::status` returned by `run()`, the status code is either 0 (success) or 2 (maximum iterations reached without convergence).
+ *
+ * @tparam Matrix_ Matrix type for the input data.
+ * This should satisfy the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centroids.
+ *
+ * @see
+ * Elkan, C. (2003).
+ * Using the triangle inequality to accelerate k-means.
+ * _Proceedings of the Twentieth International Conference on Machine Learning_, 147-153.
+ */
+template<typename Matrix_ = SimpleMatrix<double, int>, typename Cluster_ = int, typename Float_ = double>
+class RefineElkan : public Refine<Matrix_, Cluster_, Float_> {
+private:
+    RefineElkanOptions my_options;
+
+    typedef typename Matrix_::index_type Index_;
+
+public:
+    /**
+     * @param options Further options to the Elkan algorithm.
+     */
+    RefineElkan(RefineElkanOptions options) : my_options(std::move(options)) {}
+
+    /**
+     * Default constructor.
+     */
+    RefineElkan() = default;
+
+public:
+    /**
+     * @return Options for Elkan clustering,
+     * to be modified prior to calling `run()`.
+     */
+    RefineElkanOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    Details<Index_> run(const Matrix_& data, Cluster_ ncenters, Float_* centers, Cluster_* clusters) const {
+        auto nobs = data.num_observations();
+        if (internal::is_edge_case(nobs, ncenters)) {
+            return internal::process_edge_case(data, ncenters, centers, clusters);
+        }
+
+        auto ndim = data.num_dimensions();
+        size_t long_ndim = ndim;
+        size_t long_ncenters = ncenters;
+
+        std::vector<Float_> upper(nobs);
+        std::vector<Float_> lower(long_ncenters * static_cast<size_t>(nobs)); // cast to avoid overflow.
+        std::vector<Float_> center_dist, closest_center;
+        std::vector<Float_> drift(ncenters);
+        std::vector<Float_> previous(long_ndim * long_ncenters);
+
+        int iter = 0, status = 0;
+        std::vector<Index_> sizes(ncenters);
+        std::vector<Cluster_> copy(nobs);
+
+        for (iter = 1; iter <= my_options.max_iterations; ++iter) {
+            if (iter == 1) {
+                // No bounds are available yet, so we compute all distances to initialize them.
+                parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(start, length);
+                    for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                        auto dptr = data.get_observation(work);
+                        auto obs_lower = lower.data() + static_cast<size_t>(obs) * long_ncenters; // cast to avoid overflow.
+
+                        Cluster_ best = 0;
+                        Float_ best_dist = std::numeric_limits<Float_>::max();
+                        for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                            auto dist = internal::distance(centers + static_cast<size_t>(cen) * long_ndim, dptr, ndim);
+                            obs_lower[cen] = dist;
+                            if (dist < best_dist) {
+                                best = cen;
+                                best_dist = dist;
+                            }
+                        }
+
+                        copy[obs] = best;
+                        upper[obs] = best_dist;
+                    }
+                });
+
+            } else {
+                internal::compute_center_distances(ndim, ncenters, centers, center_dist, closest_center, my_options.num_threads);
+
+                parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(start, length);
+                    for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                        auto dptr = data.get_observation(work);
+                        auto obs_lower = lower.data() + static_cast<size_t>(obs) * long_ncenters; // cast to avoid overflow.
+
+                        // Shifting the bounds by the movement of the centers in the previous iteration.
+                        for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                            obs_lower[cen] = std::max(obs_lower[cen] - drift[cen], static_cast<Float_>(0));
+                        }
+                        auto best = copy[obs];
+                        auto& best_dist = upper[obs];
+                        best_dist += drift[best];
+
+                        // If the assigned center is closer than half the distance to any other center, it must be the closest.
+                        if (best_dist <= closest_center[best] / 2) {
+                            continue;
+                        }
+
+                        bool tight = false;
+                        for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                            if (cen == best) {
+                                continue;
+                            }
+
+                            auto best_cen_dist = center_dist[static_cast<size_t>(best) * long_ncenters + static_cast<size_t>(cen)]; // cast to avoid overflow.
+                            if (best_dist <= obs_lower[cen] || best_dist <= best_cen_dist / 2) {
+                                continue;
+                            }
+
+                            // Tightening the upper bound before computing the distance to the candidate center,
+                            // as this is often enough to eliminate the candidate.
+                            if (!tight) {
+                                best_dist = internal::distance(centers + static_cast<size_t>(best) * long_ndim, dptr, ndim);
+                                obs_lower[best] = best_dist;
+                                tight = true;
+                                if (best_dist <= obs_lower[cen] || best_dist <= best_cen_dist / 2) {
+                                    continue;
+                                }
+                            }
+
+                            auto dist = internal::distance(centers + static_cast<size_t>(cen) * long_ndim, dptr, ndim);
+                            obs_lower[cen] = dist;
+                            if (dist < best_dist) {
+                                best = cen;
+                                best_dist = dist;
+                            }
+                        }
+
+                        copy[obs] = best;
+                    }
+                });
+            }
+
+            // Checking if it already converged.
+            bool updated = false;
+            for (Index_ obs = 0; obs < nobs; ++obs) {
+                if (copy[obs] != clusters[obs]) {
+                    updated = true;
+                    break;
+                }
+            }
+            if (!updated) {
+                break;
+            }
+            std::copy(copy.begin(), copy.end(), clusters);
+
+            std::fill(sizes.begin(), sizes.end(), 0);
+            for (Index_ obs = 0; obs < nobs; ++obs) {
+                ++sizes[clusters[obs]];
+            }
+
+            std::copy_n(centers, previous.size(), previous.begin());
+            internal::compute_centroids(data, ncenters, centers, clusters, sizes, my_options.num_threads);
+            internal::compute_center_drift(ndim, ncenters, previous.data(), centers, drift.data());
+        }
+
+        if (iter == my_options.max_iterations + 1) {
+            status = 2;
+        }
+
+        return Details<Index_>(std::move(sizes), iter, status);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,706 @@
+#ifndef KMEANS_REFINE_FILTERING_HPP
+#define KMEANS_REFINE_FILTERING_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <utility>
+#include <cstddef>
+
+#include "Refine.hpp"
+#include "Details.hpp"
+#include "is_edge_case.hpp"
+#include "compute_centroids.hpp"
+#include "compute_distances.hpp"
+#include "parallelize.hpp"
+
+/**
+ * @file RefineFiltering.hpp
+ *
+ * @brief Implements the filtering algorithm for k-means clustering.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for `RefineFiltering` construction.
+ */
+struct RefineFilteringOptions {
+    /**
+     * Maximum number of iterations.
+     * More iterations increase the opportunity for convergence at the cost of more computational time.
+     */
+    int max_iterations = 10;
+
+    /**
+     * Maximum number of observations in each leaf node of the kd-tree.
+     * Larger values reduce the memory usage and construction time of the tree, at the cost of less effective filtering at the leaves.
+     */
+    int leaf_size = 32;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace RefineFiltering_internal {
+
+/*
+ * kd-tree over the observations, where each node is split at the median of
+ * the dimension with the largest spread. Nodes are laid out in pre-order, so
+ * the left child of each internal node is immediately after it, and each
+ * subtree occupies a contiguous range of positions. Each node also covers a
+ * contiguous range of observations after they are reordered into the tree
+ * order, which is how we store their coordinates for cache-friendly access.
+ * For each node, we store the bounding box of its observations and the sum of
+ * their coordinates, so that the contribution of an entire subtree to the
+ * centroids can be added in one step.
+ */
+template<typename Index_, typename Float_, typename Dim_>
+class KdTree {
+public:
+    struct Node {
+        Index_ begin, end;
+
+        // Position of the right child, or 0 if this is a leaf.
+        size_t right;
+
+        // Position immediately after the last node in this subtree.
+        size_t subtree_end;
+    };
+
+private:
+    Dim_ my_num_dim;
+    size_t my_long_num_dim;
+    size_t my_leaf_size;
+
+    std::vector<Float_> my_points;
+    std::vector<Index_> my_order;
+    std::vector<Node> my_nodes;
+
+    // For each node, the lower corner, upper corner and sum of its observations, each of length 'my_num_dim'.
+    std::vector<Float_> my_values;
+
+public:
+    template<class Matrix_>
+    KdTree(const Matrix_& data, Index_ leaf_size, int nthreads) :
+        my_num_dim(data.num_dimensions()),
+        my_long_num_dim(my_num_dim),
+        my_leaf_size(std::max(leaf_size, static_cast<Index_>(1)))
+    {
+        Index_ nobs = data.num_observations();
+        my_points.resize(my_long_num_dim * static_cast<size_t>(nobs)); // cast to avoid overflow.
+        parallelize(nthreads, nobs, [&](int, Index_ start, Index_ length) -> void {
+            auto work = data.create_workspace(start, length);
+            auto dest = my_points.data() + static_cast<size_t>(start) * my_long_num_dim; // cast to avoid overflow.
+            for (Index_ i = 0; i < length; ++i, dest += my_long_num_dim) {
+                auto ptr = data.get_observation(work);
+                for (Dim_ d = 0; d < my_num_dim; ++d) {
+                    dest[d] = ptr[d]; // cast to ensure consistent precision regardless of Matrix_::data_type.
+                }
+            }
+        });
+
+        my_order.resize(nobs);
+        std::iota(my_order.begin(), my_order.end(), static_cast<Index_>(0));
+        my_nodes.resize(count_nodes(nobs).first);
+        my_values.resize(my_nodes.size() * my_long_num_dim * 3);
+        if (nthreads > 1) {
+            build_parallel(nobs, nthreads);
+        } else {
+            build(0, 0, nobs);
+        }
+
+        permute_points();
+    }
+
+public:
+    Dim_ num_dimensions() const {
+        return my_num_dim;
+    }
+
+    const Node& node(size_t pos) const {
+        return my_nodes[pos];
+    }
+
+    size_t num_nodes() const {
+        return my_nodes.size();
+    }
+
+    const Float_* lower(size_t pos) const {
+        return my_values.data() + pos * my_long_num_dim * 3;
+    }
+
+    const Float_* upper(size_t pos) const {
+        return lower(pos) + my_long_num_dim;
+    }
+
+    const Float_* sum(size_t pos) const {
+        return lower(pos) + my_long_num_dim * 2;
+    }
+
+    // Coordinates of the observation at position 'p' in the tree order.
+    const Float_* point(Index_ p) const {
+        return my_points.data() + static_cast<size_t>(p) * my_long_num_dim; // cast to avoid overflow.
+    }
+
+    // Original index of the observation at position 'p' in the tree order.
+    Index_ original(Index_ p) const {
+        return my_order[p];
+    }
+
+private:
+    /*
+     * Returns the number of nodes in the trees for 'size' and 'size + 1'
+     * observations. The two halves of 'size' and 'size + 1' are always either
+     * 'size / 2' or 'size / 2 + 1', so we only need to recurse once per level.
+     */
+    std::pair<size_t, size_t> count_nodes(size_t size) const {
+        if (size + 1 <= my_leaf_size) {
+            return std::make_pair(1, 1);
+        }
+        if (size <= my_leaf_size) {
+            return std::make_pair(1, 3); // both halves of 'size + 1' must be leaves.
+        }
+
+        size_t half = size / 2;
+        auto sub = count_nodes(half);
+        auto get = [&](size_t x) -> size_t { return (x == half ? sub.first : sub.second); };
+        return std::make_pair(
+            1 + get(size / 2) + get(size - size / 2),
+            1 + get((size + 1) / 2) + get(size + 1 - (size + 1) / 2)
+        );
+    }
+
+    Float_* mutable_lower(size_t pos) {
+        return my_values.data() + pos * my_long_num_dim * 3;
+    }
+
+    const Float_* original_point(Index_ i) const {
+        return my_points.data() + static_cast<size_t>(i) * my_long_num_dim; // cast to avoid overflow.
+    }
+
+    // Sets up the node at 'pos' for observations [begin, end) of 'my_order'. Returns the split point for internal nodes, or 'end' for leaves.
+    Index_ split(size_t pos, Index_ begin, Index_ end) {
+        auto& node = my_nodes[pos];
+        node.begin = begin;
+        node.end = end;
+
+        auto lower = mutable_lower(pos);
+        auto upper = lower + my_long_num_dim;
+        auto sum = upper + my_long_num_dim;
+        std::fill_n(lower, my_num_dim, std::numeric_limits<Float_>::max());
+        std::fill_n(upper, my_num_dim, std::numeric_limits<Float_>::lowest());
+        for (Index_ i = begin; i < end; ++i) {
+            auto ptr = original_point(my_order[i]);
+            for (Dim_ d = 0; d < my_num_dim; ++d) {
+                lower[d] = std::min(lower[d], ptr[d]);
+                upper[d] = std::max(upper[d], ptr[d]);
+            }
+        }
+
+        size_t size = end - begin;
+        if (size <= my_leaf_size) {
+            std::fill_n(sum, my_num_dim, 0);
+            for (Index_ i = begin; i < end; ++i) {
+                auto ptr = original_point(my_order[i]);
+                for (Dim_ d = 0; d < my_num_dim; ++d) {
+                    sum[d] += ptr[d];
+                }
+            }
+            node.right = 0;
+            node.subtree_end = pos + 1;
+            return end;
+        }
+
+        Dim_ split_dim = 0;
+        Float_ widest = -1;
+        for (Dim_ d = 0; d < my_num_dim; ++d) {
+            Float_ spread = upper[d] - lower[d];
+            if (spread > widest) {
+                widest = spread;
+                split_dim = d;
+            }
+        }
+
+        Index_ mid = begin + (end - begin) / 2;
+        std::nth_element(my_order.begin() + begin, my_order.begin() + mid, my_order.begin() + end, [&](Index_ l, Index_ r) -> bool {
+            return original_point(l)[split_dim] < original_point(r)[split_dim];
+        });
+
+        node.right = pos + 1 + count_nodes(mid - begin).first;
+        node.subtree_end = pos + count_nodes(size).first;
+        return mid;
+    }
+
+    // Sums are computed from the children, so this should only be called after both subtrees are built.
+    void merge_sums(size_t pos) {
+        const auto& node = my_nodes[pos];
+        auto sum = mutable_lower(pos) + 2 * my_long_num_dim;
+        auto left = this->sum(pos + 1), right = this->sum(node.right);
+        for (Dim_ d = 0; d < my_num_dim; ++d) {
+            sum[d] = left[d] + right[d];
+        }
+    }
+
+    void build(size_t pos, Index_ begin, Index_ end) {
+        Index_ mid = split(pos, begin, end);
+        if (mid == end) {
+            return;
+        }
+        build(pos + 1, begin, mid);
+        build(my_nodes[pos].right, mid, end);
+        merge_sums(pos);
+    }
+
+    /*
+     * For parallel construction, we serially split the top few levels of the
+     * tree until there are enough independent subtrees, build the subtrees in
+     * parallel, and then compute the sums for the top levels. This gives the
+     * same tree as the serial build as the splits do not depend on the order
+     * in which the nodes are processed.
+     */
+    void build_parallel(Index_ nobs, int nthreads) {
+        struct Task {
+            size_t pos;
+            Index_ begin, end;
+        };
+        std::vector<Task> tasks, next;
+        std::vector<size_t> expanded;
+        tasks.push_back(Task{ 0, 0, nobs });
+
+        size_t target = static_cast<size_t>(nthreads) * 4;
+        while (tasks.size() < target) {
+            next.clear();
+            bool any_expanded = false;
+            for (const auto& t : tasks) {
+                if (static_cast<size_t>(t.end - t.begin) <= my_leaf_size) {
+                    next.push_back(t);
+                    continue;
+                }
+                Index_ mid = split(t.pos, t.begin, t.end);
+                expanded.push_back(t.pos);
+                any_expanded = true;
+                next.push_back(Task{ t.pos + 1, t.begin, mid });
+                next.push_back(Task{ my_nodes[t.pos].right, mid, t.end });
+            }
+            tasks.swap(next);
+            if (!any_expanded) {
+                break;
+            }
+        }
+
+        parallelize(nthreads, tasks.size(), [&](int, size_t start, size_t length) -> void {
+            for (size_t t = start, end = start + length; t < end; ++t) {
+                build(tasks[t].pos, tasks[t].begin, tasks[t].end);
+            }
+        });
+
+        // Children are always expanded after their parents, so we go backwards.
+        for (auto it = expanded.rbegin(); it != expanded.rend(); ++it) {
+            merge_sums(*it);
+        }
+    }
+
+    // Reorders the coordinates in place so that the observation at position 'p' of the tree order is stored at 'p'.
+    void permute_points() {
+        size_t nobs = my_order.size();
+        std::vector<unsigned char> done(nobs);
+        std::vector<Float_> buffer(my_long_num_dim);
+        for (size_t i = 0; i < nobs; ++i) {
+            if (done[i]) {
+                continue;
+            }
+            std::copy_n(my_points.data() + i * my_long_num_dim, my_long_num_dim, buffer.data());
+            size_t j = i;
+            while (static_cast<size_t>(my_order[j]) != i) {
+                size_t source = my_order[j];
+                std::copy_n(my_points.data() + source * my_long_num_dim, my_long_num_dim, my_points.data() + j * my_long_num_dim);
+                done[j] = 1;
+                j = source;
+            }
+            std::copy_n(buffer.data(), my_long_num_dim, my_points.data() + j * my_long_num_dim);
+            done[j] = 1;
+        }
+    }
+};
+
+/*
+ * Assignment of observations to centers by filtering (Kanungo et al., 2002).
+ * Starting from the root with all centers as candidates, we find the
+ * candidate 'z*' that is closest to the midpoint of each node's bounding box.
+ * Any other candidate 'z' that is further than 'z*' from the box vertex in the
+ * direction of 'z - z*' cannot be the closest center for any observation in
+ * the box, and is removed. If only 'z*' remains, the entire subtree is
+ * assigned to it; otherwise, we recurse into the children with the remaining
+ * candidates, or compute the distances to each observation at a leaf.
+ *
+ * For each node, we also remember the center to which its entire subtree was
+ * last assigned (if any), so that we can skip updating the assignments of
+ * each observation when a subtree is assigned to the same center again.
+ */
+template<typename Index_, typename Cluster_, typename Float_, typename Dim_>
+class Filter {
+public:
+    // Contribution of a node (whole = true) or a single observation (whole = false) to a cluster.
+    struct Record {
+        size_t id;
+        Cluster_ cluster;
+        bool whole;
+    };
+
+    struct Workspace {
+        std::vector<Cluster_> candidates;
+        std::vector<Record> records;
+        std::vector<Float_> midpoint;
+        bool changed = false;
+    };
+
+private:
+    const KdTree<Index_, Float_, Dim_>& my_tree;
+    Dim_ my_num_dim;
+    size_t my_long_num_dim;
+    Cluster_ my_num_centers;
+    int my_num_threads;
+
+    // Cluster_ might be unsigned, so we use 'my_num_centers' to indicate that a node is not wholly assigned to any cluster.
+    std::vector<Cluster_> my_owners;
+
+    /*
+     * The top levels of the tree are filtered serially, and the children of
+     * the internal nodes at 'task_depth' are filtered in parallel. Contributions are then added in
+     * a fixed order (top levels first, then each subtree in turn), so the
+     * centroids do not depend on the number of threads.
+     */
+    static constexpr int task_depth = 7;
+
+    struct Task {
+        size_t pos;
+        std::vector<Cluster_> candidates;
+        Workspace work;
+    };
+    Workspace my_top;
+    std::vector<Task> my_tasks;
+    size_t my_num_tasks = 0;
+
+public:
+    Filter(const KdTree<Index_, Float_, Dim_>& tree, Cluster_ ncenters, int nthreads) :
+        my_tree(tree),
+        my_num_dim(tree.num_dimensions()),
+        my_long_num_dim(my_num_dim),
+        my_num_centers(ncenters),
+        my_num_threads(nthreads),
+        my_owners(tree.num_nodes(), ncenters)
+    {}
+
+private:
+    const Float_* get_center(const Float_* centers, Cluster_ c) const {
+        return centers + static_cast<size_t>(c) * my_long_num_dim; // cast to avoid overflow.
+    }
+
+    // Is 'z' no closer than 'zstar' to every point in the box? We only need to check the vertex that is furthest in the direction of 'z - zstar'.
+    bool is_farther(const Float_* z, const Float_* zstar, const Float_* lower, const Float_* upper) const {
+        Float_ zdist = 0, zstar_dist = 0;
+        for (Dim_ d = 0; d < my_num_dim; ++d) {
+            Float_ vertex = (z[d] > zstar[d] ? upper[d] : lower[d]);
+            Float_ zdelta = z[d] - vertex;
+            zdist += zdelta * zdelta;
+            Float_ zstar_delta = zstar[d] - vertex;
+            zstar_dist += zstar_delta * zstar_delta;
+        }
+        return zdist >= zstar_dist;
+    }
+
+    void assign(Index_ p, Cluster_ cluster, Cluster_* clusters, Workspace& work) const {
+        auto& current = clusters[my_tree.original(p)];
+        if (current != cluster) {
+            current = cluster;
+            work.changed = true;
+        }
+    }
+
+    void assign_whole(size_t pos, Cluster_ cluster, Cluster_* clusters, Workspace& work) {
+        work.records.push_back(Record{ pos, cluster, true });
+        if (my_owners[pos] == cluster) {
+            return;
+        }
+
+        const auto& node = my_tree.node(pos);
+        for (Index_ p = node.begin; p < node.end; ++p) {
+            assign(p, cluster, clusters, work);
+        }
+        std::fill(my_owners.begin() + pos, my_owners.begin() + node.subtree_end, cluster);
+    }
+
+    void assign_leaf(size_t pos, size_t cstart, size_t cend, const Float_* centers, Cluster_* clusters, Workspace& work) {
+        const auto& node = my_tree.node(pos);
+        const auto& candidates = work.candidates;
+        bool all_same = true;
+        Cluster_ first = 0;
+
+        for (Index_ p = node.begin; p < node.end; ++p) {
+            auto ptr = my_tree.point(p);
+            Cluster_ best = candidates[cstart];
+            Float_ best_dist = internal::raw_distance(get_center(centers, best), ptr, my_num_dim);
+            for (size_t c = cstart + 1; c < cend; ++c) {
+                auto dist = internal::raw_distance(get_center(centers, candidates[c]), ptr, my_num_dim);
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = candidates[c];
+                }
+            }
+
+            work.records.push_back(Record{ static_cast<size_t>(p), best, false });
+            assign(p, best, clusters, work);
+            if (p == node.begin) {
+                first = best;
+            } else if (best != first) {
+                all_same = false;
+            }
+        }
+
+        my_owners[pos] = (all_same ? first : my_num_centers);
+    }
+
+    // Candidates for the current node are stored in [cstart, cend) of 'work.candidates'.
+    void filter(size_t pos, size_t cstart, size_t cend, int depth, const Float_* centers, Cluster_* clusters, Workspace& work) {
+        auto& candidates = work.candidates;
+        const auto& node = my_tree.node(pos);
+        auto lower = my_tree.lower(pos);
+        auto upper = my_tree.upper(pos);
+
+        Cluster_ zstar = candidates[cstart];
+        if (cend - cstart > 1) {
+            auto& midpoint = work.midpoint;
+            for (Dim_ d = 0; d < my_num_dim; ++d) {
+                midpoint[d] = (lower[d] + upper[d]) / 2;
+            }
+            Float_ best_dist = std::numeric_limits<Float_>::max();
+            for (size_t c = cstart; c < cend; ++c) {
+                auto dist = internal::raw_distance(get_center(centers, candidates[c]), midpoint.data(), my_num_dim);
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    zstar = candidates[c];
+                }
+            }
+        }
+
+        size_t nstart = candidates.size();
+        auto zstar_ptr = get_center(centers, zstar);
+        for (size_t c = cstart; c < cend; ++c) {
+            auto z = candidates[c];
+            if (z == zstar || !is_farther(get_center(centers, z), zstar_ptr, lower, upper)) {
+                candidates.push_back(z);
+            }
+        }
+        size_t nend = candidates.size();
+
+        if (nend - nstart == 1) {
+            assign_whole(pos, zstar, clusters, work);
+        } else if (node.right == 0) {
+            assign_leaf(pos, nstart, nend, centers, clusters, work);
+        } else {
+            my_owners[pos] = my_num_centers;
+            if (depth == task_depth) {
+                // Deferring the children of this node to a parallel task.
+                auto& task = my_tasks[my_num_tasks];
+                task.pos = pos;
+                task.candidates.assign(candidates.begin() + nstart, candidates.end());
+                ++my_num_tasks;
+            } else {
+                filter(pos + 1, nstart, nend, depth + 1, centers, clusters, work);
+                filter(node.right, nstart, nend, depth + 1, centers, clusters, work);
+            }
+        }
+
+        candidates.resize(nstart);
+    }
+
+    static void prepare(Workspace& work, Dim_ ndim) {
+        work.candidates.clear();
+        work.records.clear();
+        work.midpoint.resize(ndim);
+        work.changed = false;
+    }
+
+    template<class Function_>
+    void for_each_record(Function_ fun) const {
+        for (const auto& rec : my_top.records) {
+            fun(rec);
+        }
+        for (size_t t = 0; t < my_num_tasks; ++t) {
+            for (const auto& rec : my_tasks[t].work.records) {
+                fun(rec);
+            }
+        }
+    }
+
+    void add_record(const Record& rec, Float_* sums, std::vector<Index_>& sizes) const {
+        auto cursum = sums + static_cast<size_t>(rec.cluster) * my_long_num_dim; // cast to avoid overflow.
+        const Float_* source;
+        if (rec.whole) {
+            source = my_tree.sum(rec.id);
+            const auto& node = my_tree.node(rec.id);
+            sizes[rec.cluster] += node.end - node.begin;
+        } else {
+            source = my_tree.point(rec.id);
+            ++sizes[rec.cluster];
+        }
+        for (Dim_ d = 0; d < my_num_dim; ++d) {
+            cursum[d] += source[d];
+        }
+    }
+
+public:
+    /*
+     * Assigns each observation to its closest center, storing the assignments
+     * in 'clusters' (indexed by the original observation order). The sum of
+     * coordinates and number of observations for each cluster are stored in
+     * 'sums' and 'sizes', respectively. Returns whether any assignment changed.
+     */
+    bool run(const Float_* centers, Cluster_* clusters, Float_* sums, std::vector<Index_>& sizes) {
+        // The number of nodes at 'task_depth' is bounded by 2^task_depth.
+        my_tasks.resize(static_cast<size_t>(1) << task_depth);
+        my_num_tasks = 0;
+
+        prepare(my_top, my_num_dim);
+        auto& candidates = my_top.candidates;
+        for (Cluster_ c = 0; c < my_num_centers; ++c) {
+            candidates.push_back(c);
+        }
+        filter(0, 0, candidates.size(), 0, centers, clusters, my_top);
+
+        parallelize(my_num_threads, my_num_tasks, [&](int, size_t start, size_t length) -> void {
+            for (size_t t = start, end = start + length; t < end; ++t) {
+                auto& task = my_tasks[t];
+                auto& work = task.work;
+                prepare(work, my_num_dim);
+                work.candidates.insert(work.candidates.end(), task.candidates.begin(), task.candidates.end());
+                size_t ncandidates = work.candidates.size();
+                filter(task.pos + 1, 0, ncandidates, task_depth + 1, centers, clusters, work);
+                filter(my_tree.node(task.pos).right, 0, ncandidates, task_depth + 1, centers, clusters, work);
+            }
+        });
+
+        bool changed = my_top.changed;
+        for (size_t t = 0; t < my_num_tasks; ++t) {
+            changed = changed || my_tasks[t].work.changed;
+        }
+
+        // Each thread takes ownership of a contiguous range of clusters, so the
+        // contributions for each cluster are always added in the same order.
+        std::fill_n(sums, my_long_num_dim * static_cast<size_t>(my_num_centers), 0); // cast to avoid overflow.
+        std::fill(sizes.begin(), sizes.end(), 0);
+        parallelize(my_num_threads, my_num_centers, [&](int, Cluster_ start, Cluster_ length) -> void {
+            Cluster_ end = start + length;
+            for_each_record([&](const Record& rec) -> void {
+                if (rec.cluster >= start && rec.cluster < end) {
+                    add_record(rec, sums, sizes);
+                }
+            });
+        });
+
+        return changed;
+    }
+};
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Implements the filtering algorithm for k-means clustering.
+ *
+ * The filtering algorithm produces the same batch assignments as `RefineLloyd` (up to the breaking of ties between equidistant centers).
+ * A kd-tree is built once from the observations, where each node stores the bounding box of its observations as well as the sum of their coordinates.
+ * In each iteration, we push a set of candidate centers down the tree,
+ * removing any candidate that cannot be the closest center for any point in a node's bounding box.
+ * Once only one candidate remains, the entire subtree is assigned to that center and its stored sum is added to that center's centroid in a single step.
+ * Otherwise, the distances to the remaining candidates are only computed for the observations in the leaf nodes.
+ *
+ * This is very effective for low-dimensional data (e.g., up to 8 dimensions) with many observations, where most of the tree is assigned without touching individual observations.
+ * The effectiveness decreases with increasing dimensionality as the bounding boxes are less able to distinguish between centers.
+ * Note that the centroids are computed by adding the sums of entire subtrees, so they may differ slightly from those of `RefineLloyd` due to floating-point round-off.
+ * The tree also requires a copy of the data in the floating-point type, in addition to the nodes themselves.
+ *
+ * In the `Details::status` returned by `run()`, the status code is either 0 (success) or 2 (maximum iterations reached without convergence).
+ *
+ * @tparam Matrix_ Matrix type for the input data.
+ * This should satisfy the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centroids.
+ *
+ * @see
+ * Kanungo, T., Mount, D. M., Netanyahu, N. S., Piatko, C. D., Silverman, R. and Wu, A. Y. (2002).
+ * An efficient k-means clustering algorithm: analysis and implementation.
+ * _IEEE Transactions on Pattern Analysis and Machine Intelligence_ 24, 881-892.
+ */
+template<typename Matrix_ = SimpleMatrix<double, int>, typename Cluster_ = int, typename Float_ = double>
+class RefineFiltering : public Refine<Matrix_, Cluster_, Float_> {
+private:
+    RefineFilteringOptions my_options;
+
+    typedef typename Matrix_::index_type Index_;
+
+public:
+    /**
+     * @param options Further options to the filtering algorithm.
+     */
+    RefineFiltering(RefineFilteringOptions options) : my_options(std::move(options)) {}
+
+    /**
+     * Default constructor.
+     */
+    RefineFiltering() = default;
+
+public:
+    /**
+     * @return Options for filtering clustering,
+     * to be modified prior to calling `run()`.
+     */
+    RefineFilteringOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    Details<Index_> run(const Matrix_& data, Cluster_ ncenters, Float_* centers, Cluster_* clusters) const {
+        auto nobs = data.num_observations();
+        if (internal::is_edge_case(nobs, ncenters)) {
+            return internal::process_edge_case(data, ncenters, centers, clusters);
+        }
+
+        auto ndim = data.num_dimensions();
+        typedef decltype(ndim) Dim_;
+        RefineFiltering_internal::KdTree<Index_, Float_, Dim_> tree(data, my_options.leaf_size, my_options.num_threads);
+        RefineFiltering_internal::Filter<Index_, Cluster_, Float_, Dim_> filter(tree, ncenters, my_options.num_threads);
+
+        int iter = 0, status = 0;
+        std::vector<Index_> sizes(ncenters);
+        std::vector<Float_> sums(static_cast<size_t>(ndim) * static_cast<size_t>(ncenters)); // cast to avoid overflow.
+
+        for (iter = 1; iter <= my_options.max_iterations; ++iter) {
+            bool updated = filter.run(centers, clusters, sums.data(), sizes);
+            if (!updated) {
+                break;
+            }
+            internal::compute_centroids_from_sums(ndim, ncenters, sums.data(), centers, sizes);
+        }
+
+        if (iter == my_options.max_iterations + 1) {
+            status = 2;
+        }
+
+        return Details<Index_>(std::move(sizes), iter, status);
+    }
+};
+
+}
+
+#endif
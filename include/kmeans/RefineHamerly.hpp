@@ -0,0 +1,217 @@
+#ifndef KMEANS_REFINE_HAMERLY_HPP
+#define KMEANS_REFINE_HAMERLY_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "Refine.hpp"
+#include "Details.hpp"
+#include "is_edge_case.hpp"
+#include "compute_centroids.hpp"
+#include "compute_distances.hpp"
+#include "parallelize.hpp"
+
+/**
+ * @file RefineHamerly.hpp
+ *
+ * @brief Implements Hamerly's accelerated Lloyd algorithm for k-means clustering.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for `RefineHamerly` construction.
+ */
+struct RefineHamerlyOptions {
+    /**
+     * Maximum number of iterations.
+     * More iterations increase the opportunity for convergence at the cost of more computational time.
+     */
+    int max_iterations = 10;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @brief Implements Hamerly's accelerated Lloyd algorithm for k-means clustering.
+ *
+ * Hamerly's algorithm produces the same batch assignments and center calculations as `RefineLloyd` (up to the breaking of ties between equidistant centers).
+ * For each observation, we store an upper bound on the distance to its assigned center and a single lower bound on the distance to the second-closest center.
+ * These bounds are adjusted by the distance that the centers move in each iteration.
+ * If the upper bound is no greater than the lower bound or half the distance from the assigned center to its nearest neighboring center, the assignment cannot change and the observation is skipped.
+ * Otherwise, we tighten the upper bound and, if necessary, compute the distances to all centers.
+ *
+ * Compared to `RefineElkan`, this approach only requires storage that is linear in the number of observations,
+ * at the cost of being less effective at pruning distance calculations for large numbers of centers.
+ * It works best for datasets with moderate numbers of centers and dimensions.
+ *
+ * In the `Details::status` returned by `run()`, the status code is either 0 (success) or 2 (maximum iterations reached without convergence).
+ *
+ * @tparam Matrix_ Matrix type for the input data.
+ * This should satisfy the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centroids.
+ *
+ * @see
+ * Hamerly, G. (2010).
+ * Making k-means even faster.
+ * _Proceedings of the 2010 SIAM International Conference on Data Mining_, 130-140.
+ */
+template<typename Matrix_ = SimpleMatrix<double, int>, typename Cluster_ = int, typename Float_ = double>
+class RefineHamerly : public Refine<Matrix_, Cluster_, Float_> {
+private:
+    RefineHamerlyOptions my_options;
+
+    typedef typename Matrix_::index_type Index_;
+
+public:
+    /**
+     * @param options Further options to the Hamerly algorithm.
+     */
+    RefineHamerly(RefineHamerlyOptions options) : my_options(std::move(options)) {}
+
+    /**
+     * Default constructor.
+     */
+    RefineHamerly() = default;
+
+public:
+    /**
+     * @return Options for Hamerly clustering,
+     * to be modified prior to calling `run()`.
+     */
+    RefineHamerlyOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    Details<Index_> run(const Matrix_& data, Cluster_ ncenters, Float_* centers, Cluster_* clusters) const {
+        auto nobs = data.num_observations();
+        if (internal::is_edge_case(nobs, ncenters)) {
+            return internal::process_edge_case(data, ncenters, centers, clusters);
+        }
+
+        auto ndim = data.num_dimensions();
+        size_t long_ndim = ndim;
+
+        std::vector<Float_> upper(nobs), lower(nobs);
+        std::vector<Float_> closest_center;
+        std::vector<Float_> drift(ncenters);
+        std::vector<Float_> previous(long_ndim * static_cast<size_t>(ncenters)); // cast to avoid overflow.
+
+        int iter = 0, status = 0;
+        std::vector<Index_> sizes(ncenters);
+        std::vector<Cluster_> copy(nobs);
+
+        // Finds the closest and second-closest centers from scratch.
+        auto search_all = [&](const typename Matrix_::data_type* dptr, Index_ obs) -> void {
+            Cluster_ best = 0;
+            Float_ best_dist = std::numeric_limits<Float_>::max();
+            Float_ second_dist = std::numeric_limits<Float_>::max();
+            for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                auto dist = internal::distance(centers + static_cast<size_t>(cen) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                if (dist < best_dist) {
+                    second_dist = best_dist;
+                    best = cen;
+                    best_dist = dist;
+                } else if (dist < second_dist) {
+                    second_dist = dist;
+                }
+            }
+
+            copy[obs] = best;
+            upper[obs] = best_dist;
+            lower[obs] = second_dist;
+        };
+
+        for (iter = 1; iter <= my_options.max_iterations; ++iter) {
+            if (iter == 1) {
+                parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(start, length);
+                    for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                        search_all(data.get_observation(work), obs);
+                    }
+                });
+
+            } else {
+                internal::compute_closest_center_distances(ndim, ncenters, centers, closest_center, my_options.num_threads);
+
+                // The lower bound for each observation is shifted by the largest movement of any center other than its assigned center.
+                Cluster_ max_drift_cluster = 0;
+                Float_ max_drift = 0, second_max_drift = 0;
+                for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                    if (drift[cen] > max_drift) {
+                        second_max_drift = max_drift;
+                        max_drift = drift[cen];
+                        max_drift_cluster = cen;
+                    } else if (drift[cen] > second_max_drift) {
+                        second_max_drift = drift[cen];
+                    }
+                }
+
+                parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(start, length);
+                    for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                        auto dptr = data.get_observation(work);
+
+                        auto best = copy[obs];
+                        auto& best_dist = upper[obs];
+                        best_dist += drift[best];
+                        auto& second_dist = lower[obs];
+                        second_dist -= (best == max_drift_cluster ? second_max_drift : max_drift);
+
+                        auto threshold = std::max(closest_center[best] / 2, second_dist);
+                        if (best_dist <= threshold) {
+                            continue;
+                        }
+
+                        // Tightening the upper bound, which is often enough to avoid a full search.
+                        best_dist = internal::distance(centers + static_cast<size_t>(best) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                        if (best_dist <= threshold) {
+                            continue;
+                        }
+
+                        search_all(dptr, obs);
+                    }
+                });
+            }
+
+            // Checking if it already converged.
+            bool updated = false;
+            for (Index_ obs = 0; obs < nobs; ++obs) {
+                if (copy[obs] != clusters[obs]) {
+                    updated = true;
+                    break;
+                }
+            }
+            if (!updated) {
+                break;
+            }
+            std::copy(copy.begin(), copy.end(), clusters);
+
+            std::fill(sizes.begin(), sizes.end(), 0);
+            for (Index_ obs = 0; obs < nobs; ++obs) {
+                ++sizes[clusters[obs]];
+            }
+
+            std::copy_n(centers, previous.size(), previous.begin());
+            internal::compute_centroids(data, ncenters, centers, clusters, sizes, my_options.num_threads);
+            internal::compute_center_drift(ndim, ncenters, previous.data(), centers, drift.data());
+        }
+
+        if (iter == my_options.max_iterations + 1) {
+            status = 2;
+        }
+
+        return Details<Index_>(std::move(sizes), iter, status);
+    }
+};
+
+}
+
+#endif
@@ -5,12 +5,16 @@
 #include <algorithm>
 #include <numeric>
 #include <cstdint>
+#include <cmath>
+#include <limits>
 
 #include "Refine.hpp"
 #include "Details.hpp"
-#include "QuickSearch.hpp"
+#include "CenterSearch.hpp"
+#include "AssignmentStrategy.hpp"
 #include "parallelize.hpp"
 #include "compute_centroids.hpp"
+#include "compute_distances.hpp"
 #include "is_edge_case.hpp"
 
 /**
@@ -21,6 +25,26 @@
 
 namespace kmeans {
 
+/**
+ * Policy for recomputing the centroids from scratch in `RefineHartiganWong`.
+ * The centroids are updated incrementally whenever an observation is transferred between clusters,
+ * but this accumulates numerical error over many transfers (e.g., adding a whole bunch of values and then subtracting them again leaves behind some cancellation error).
+ * A full recomputation removes this error at the cost of an extra pass over the dataset.
+ *
+ * - `EVERY_ITERATION` recomputes the centroids after the quick transfer stage of every iteration.
+ *   This mimics the behavior of R's `kmeans()` implementation.
+ * - `PERIODIC` recomputes the centroids after every `RefineHartiganWongOptions::centroid_recomputation_interval` iterations.
+ * - `DRIFT` recomputes the centroids when any cluster has received more than `RefineHartiganWongOptions::centroid_recomputation_max_updates` incremental updates since the last recomputation.
+ *   This skips the recomputation in later iterations where few observations are transferred and the accumulated error is negligible.
+ *
+ * For all policies, the centroids are recomputed before returning from `RefineHartiganWong::run()` if any incremental updates were made since the last recomputation.
+ */
+enum class CentroidRecomputation : char {
+    EVERY_ITERATION,
+    PERIODIC,
+    DRIFT
+};
+
 /** 
  * @brief Options for `RefineHartiganWong`.
  */
@@ -43,6 +67,63 @@ struct RefineHartiganWongOptions {
      */
     bool quit_on_quick_transfer_convergence_failure = false;
 
+    /**
+     * Strategy for finding the closest and second-closest centers for each observation in the initial assignment.
+     * The strategy that was actually used is reported in `Details::assignment_strategy`.
+     */
+    AssignmentStrategy assignment_strategy = AssignmentStrategy::AUTOMATIC;
+
+    /**
+     * Whether to parallelize the optimal transfer stage across `RefineHartiganWongOptions::num_threads` threads.
+     * If false, only the initial assignment is parallelized.
+     * Blocks of observations are evaluated in parallel against the current centers, and the transfers are then committed serially with re-evaluation against any clusters that changed within the block.
+     * This yields exactly the same results as the serial algorithm, i.e., the R-compatible ordering of transfers is preserved.
+     * It is most effective when transfers are rare, e.g., in later iterations or with good initial centers;
+     * if most observations are transferred, much of the work is repeated and the parallel mode may be slower than the serial default.
+     */
+    bool parallel_optimal_transfer = false;
+
+    /**
+     * Whether to store the WCSS loss for each observation in single precision.
+     * This reduces the memory usage of the workspace from 12 to 8 bytes per observation when `Float_` is a `double` (and the cluster type is 32 bits).
+     * The optimal transfer stage always uses the full-precision loss, but the quick transfer stage may compare gains against the stored loss,
+     * so the results may differ slightly from the default in the presence of near-ties.
+     */
+    bool float_wcss_loss = false;
+
+    /**
+     * Policy for recomputing the centroids from scratch.
+     */
+    CentroidRecomputation centroid_recomputation = CentroidRecomputation::EVERY_ITERATION;
+
+    /**
+     * Number of iterations between recomputations of the centroids when `RefineHartiganWongOptions::centroid_recomputation = CentroidRecomputation::PERIODIC`.
+     * Values less than 1 are treated as 1.
+     */
+    int centroid_recomputation_interval = 5;
+
+    /**
+     * Maximum number of incremental updates to any single cluster before its centroids are recomputed,
+     * when `RefineHartiganWongOptions::centroid_recomputation = CentroidRecomputation::DRIFT`.
+     */
+    int centroid_recomputation_max_updates = 1000;
+
+    /**
+     * Whether to measure the drift of the incrementally updated centroids at each recomputation.
+     * If true, the maximum absolute difference between the incrementally updated and recomputed coordinates is reported in `Details::max_centroid_drift`.
+     * This is useful for tuning `RefineHartiganWongOptions::centroid_recomputation` and its associated parameters.
+     */
+    bool report_centroid_drift = false;
+
+    /**
+     * Whether to use the triangle inequality to skip candidate destinations in the optimal transfer stage.
+     * This yields exactly the same results as without pruning, but requires a matrix of center-to-center distances,
+     * i.e., \f$O(k^2)\f$ memory for \f$k\f$ clusters, which is rebuilt at the start of each optimal transfer stage and partially updated after each transfer.
+     * It is most effective for high-dimensional data with many clusters and many iterations;
+     * otherwise, the cost of maintaining the matrix may outweigh the savings from skipped distance calculations.
+     */
+    bool prune_optimal_transfer = false;
+
     /** 
      * Number of threads to use.
      * The parallelization scheme is defined by `parallelize()`.
@@ -184,34 +265,136 @@ public:
     bool is_live(Index_ obs) const {
         return changed_after(previous_optimal_transfer, obs);
     }
+
+    // Only meaningful at the start of an optimal_transfer call, where a
+    // cluster is live up to the returned observation.
+    bool changed_in_previous_optimal_transfer() const {
+        return my_last_iteration == previous_optimal_transfer;
+    }
+
+    bool changed_in_current_optimal_transfer() const {
+        return my_last_iteration == current_optimal_transfer;
+    }
+
+    Index_ last_observation() const {
+        return my_last_observation;
+    }
 };
 
-template<typename Float_, typename Index_, typename Cluster_>
-struct Workspace {
-    // Array arguments in the same order as supplied to R's kmns_ function.
-    std::vector<Cluster_> best_destination_cluster; // i.e., IC2
-    std::vector<Index_> cluster_sizes; // i.e., NC
+// Per-cluster state that is accessed together whenever a cluster is considered
+// as a source or destination, so we pack it into a single record instead of
+// having separate arrays, i.e., one cache miss per cluster instead of four.
+template<typename Float_, typename Index_>
+struct ClusterState {
+    Float_ loss_multiplier = 0; // i.e., AN1
+    Float_ gain_multiplier = 0; // i.e., AN2
+    UpdateHistory<Index_> history; // i.e., NCP, LIVE, and ITRAN.
+    Index_ size = 0; // i.e., NC
+    Index_ updates_since_recompute = 0;
+};
 
-    std::vector<Float_> loss_multiplier; // i.e., AN1
-    std::vector<Float_> gain_multiplier; // i.e., AN2
-    std::vector<Float_> wcss_loss; // i.e., D
+// Per-observation state, interleaved in blocks of observations so that the
+// second-best cluster and WCSS loss for each observation are stored close
+// together without any padding between the two types. 'Loss_' may be of
+// lower precision than 'Float_' to save memory when there are many
+// observations; in such cases, a block of 8 observations fits into a single
+// cache line for 32-bit types.
+template<typename Loss_, typename Cluster_>
+struct ObservationBlock {
+    static constexpr size_t size = 8;
+    Loss_ wcss_loss[size]; // i.e., D
+    Cluster_ best_destination[size]; // i.e., IC2
+};
 
-    std::vector<UpdateHistory<Index_> > update_history; // i.e., NCP, LIVE, and ITRAN. 
+template<typename Float_, typename Index_, typename Cluster_, typename Loss_ = Float_>
+struct Workspace {
+    // Array arguments in the same order as supplied to R's kmns_ function.
+    std::vector<ObservationBlock<Loss_, Cluster_> > observations;
+    std::vector<ClusterState<Float_, Index_> > clusters;
 
     Index_ optra_steps_since_last_transfer = 0; // i.e., INDX
 
+    // Compact lists of the live clusters in the current optimal_transfer call,
+    // so that we don't have to check the update history of every cluster for
+    // each observation. The first list contains clusters that were modified
+    // in the previous call, paired with the last modifying observation and
+    // sorted by decreasing observation; a cluster is only live for
+    // observations before this. The second list contains clusters that were
+    // modified in the current call, which are live for all remaining
+    // observations. Any cluster in the second list is ignored in the first.
+    std::vector<std::pair<Index_, Cluster_> > previously_live;
+    std::vector<Cluster_> currently_live;
+
+    // Copy of the centers in tiles of consecutive clusters, where each tile
+    // is stored in dimension-major order for squared_distance_from_packed_clusters(),
+    // followed by the gain multipliers for all clusters in the tile.
+    // This is only kept up to date during optimal_transfer.
+    std::vector<Float_> packed_centers;
+
+    // Matrix of center-to-center distances for pruning candidates in
+    // optimal_transfer, also only kept up to date during optimal_transfer.
+    // This is only used if 'prune' is true.
+    bool prune = false;
+    std::vector<Float_> center_distances;
+
 public:
     Workspace(Index_ nobs, Cluster_ ncenters) :
         // Sizes taken from the .Fortran() call in stats::kmeans(). 
-        best_destination_cluster(nobs), 
-        cluster_sizes(ncenters),
-        loss_multiplier(ncenters),
-        gain_multiplier(ncenters),
-        wcss_loss(nobs),
-        update_history(ncenters)
-    {}
+        observations((static_cast<size_t>(nobs) + ObservationBlock<Loss_, Cluster_>::size - 1) / ObservationBlock<Loss_, Cluster_>::size),
+        clusters(ncenters)
+    {
+        previously_live.reserve(ncenters);
+        currently_live.reserve(ncenters);
+    }
+
+public:
+    Cluster_& best_destination(Index_ obs) {
+        return observations[obs / ObservationBlock<Loss_, Cluster_>::size].best_destination[obs % ObservationBlock<Loss_, Cluster_>::size];
+    }
+
+    Cluster_ best_destination(Index_ obs) const {
+        return observations[obs / ObservationBlock<Loss_, Cluster_>::size].best_destination[obs % ObservationBlock<Loss_, Cluster_>::size];
+    }
+
+    Loss_& wcss_loss(Index_ obs) {
+        return observations[obs / ObservationBlock<Loss_, Cluster_>::size].wcss_loss[obs % ObservationBlock<Loss_, Cluster_>::size];
+    }
+
+    std::vector<Index_> cluster_sizes() const {
+        std::vector<Index_> output;
+        output.reserve(clusters.size());
+        for (const auto& cl : clusters) {
+            output.push_back(cl.size);
+        }
+        return output;
+    }
 };
 
+template<typename Float_, typename Index_, typename Cluster_, typename Loss_>
+void prepare_live_clusters(Workspace<Float_, Index_, Cluster_, Loss_>& work) {
+    work.previously_live.clear();
+    work.currently_live.clear();
+    Cluster_ ncenters = work.clusters.size();
+    for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+        const auto& history = work.clusters[cen].history;
+        if (history.changed_in_previous_optimal_transfer()) {
+            work.previously_live.emplace_back(history.last_observation(), cen);
+        }
+    }
+    std::sort(work.previously_live.begin(), work.previously_live.end(), [](const auto& left, const auto& right) -> bool {
+        return left.first > right.first;
+    });
+}
+
+template<typename Float_, typename Index_, typename Cluster_, typename Loss_>
+void set_optimal(Workspace<Float_, Index_, Cluster_, Loss_>& work, Cluster_ cen, Index_ obs) {
+    auto& history = work.clusters[cen].history;
+    if (!history.changed_in_current_optimal_transfer()) {
+        work.currently_live.push_back(cen);
+    }
+    history.set_optimal(obs);
+}
+
 template<typename Data_, typename Float_, typename Dim_>
 Float_ squared_distance_from_cluster(const Data_* data, const Float_* center, Dim_ ndim) {
     Float_ output = 0;
@@ -222,25 +405,129 @@ Float_ squared_distance_from_cluster(const Data_* data, const Float_* center, Di
     return output;
 }
 
-template<class Matrix_, typename Cluster_, typename Float_>
-void find_closest_two_centers(const Matrix_& data, Cluster_ ncenters, const Float_* centers, Cluster_* best_cluster, std::vector<Cluster_>& best_destination_cluster, int nthreads) {
+template<class Matrix_, typename Cluster_, typename Float_, typename Loss_>
+AssignmentStrategy find_closest_two_centers(const Matrix_& data, Cluster_ ncenters, const Float_* centers, Cluster_* best_cluster, Workspace<Float_, typename Matrix_::index_type, Cluster_, Loss_>& work, AssignmentStrategy strategy, int nthreads) {
     auto ndim = data.num_dimensions();
+    auto nobs = data.num_observations();
 
     // We assume that there are at least two centers here, otherwise we should
     // have detected that this was an edge case in RefineHartiganWong::run.
-    internal::QuickSearch<Float_, Cluster_, decltype(ndim)> index(ndim, ncenters, centers);
+    internal::CenterSearch<Float_, Cluster_, decltype(ndim)> index(strategy, nobs, ncenters, ndim, nthreads);
+    index.reset(ndim, ncenters, centers);
 
-    auto nobs = data.num_observations();
     typedef typename Matrix_::index_type Index_;
     parallelize(nthreads, nobs, [&](int, Index_ start, Index_ length) -> void {
         auto matwork = data.create_workspace(start, length);
-        for (Index_ obs = start, end = start + length; obs < end; ++obs) {
-            auto optr = data.get_observation(matwork);
-            auto res2 = index.find2(optr);
-            best_cluster[obs] = res2.first;
-            best_destination_cluster[obs] = res2.second;
-        }
+        auto swork = index.create_workspace();
+        index.find2(
+            swork,
+            length,
+            [&]() -> auto { return data.get_observation(matwork); },
+            [&](Index_ i, Cluster_ best, Cluster_ second) -> void {
+                best_cluster[start + i] = best;
+                work.best_destination(start + i) = second;
+            }
+        );
     });
+
+    return index.get_strategy();
+}
+
+// Same as squared_distance_from_cluster(), but for a tile of clusters at once.
+// Each distance is accumulated in exactly the same order, so the results are
+// identical; we just get a few independent accumulators for more ILP and
+// better use of the vector units.
+constexpr size_t cluster_tile_size = 4;
+
+template<typename Data_, typename Float_, typename Dim_>
+void squared_distance_from_clusters(const Data_* data, const Float_* const* centers, Dim_ ndim, Float_* output) {
+    Float_ acc[cluster_tile_size] = {};
+    for (decltype(ndim) dim = 0; dim < ndim; ++dim) {
+        Float_ oval = data[dim]; // cast to float for consistent precision regardless of Data_.
+        for (size_t t = 0; t < cluster_tile_size; ++t) {
+            Float_ delta = oval - centers[t][dim];
+            acc[t] += delta * delta;
+        }
+    }
+    std::copy_n(acc, cluster_tile_size, output);
+}
+
+template<typename Data_, typename Float_, typename Dim_>
+void squared_distance_from_packed_clusters(const Data_* data, const Float_* packed, Dim_ ndim, Float_* output) {
+    Float_ acc[cluster_tile_size] = {};
+    for (decltype(ndim) dim = 0; dim < ndim; ++dim, packed += cluster_tile_size) {
+        Float_ oval = data[dim]; // cast to float for consistent precision regardless of Data_.
+        for (size_t t = 0; t < cluster_tile_size; ++t) {
+            Float_ delta = oval - packed[t];
+            acc[t] += delta * delta;
+        }
+    }
+    std::copy_n(acc, cluster_tile_size, output);
+}
+
+template<typename Dim_>
+size_t packed_tile_size(Dim_ ndim) {
+    return (static_cast<size_t>(ndim) + 1) * cluster_tile_size; // extra row for the gain multipliers.
+}
+
+template<typename Dim_, typename Float_, typename Index_, typename Cluster_, typename Loss_>
+void pack_center(Dim_ ndim, Cluster_ cen, const Float_* centers, Workspace<Float_, Index_, Cluster_, Loss_>& work) {
+    size_t long_ndim = ndim;
+    auto src = centers + long_ndim * static_cast<size_t>(cen); // cast to avoid overflow.
+    size_t tile = cen / cluster_tile_size, lane = cen % cluster_tile_size;
+    auto dest = work.packed_centers.data() + tile * packed_tile_size(ndim) + lane;
+    for (decltype(ndim) dim = 0; dim < ndim; ++dim, dest += cluster_tile_size) {
+        *dest = src[dim];
+    }
+    *dest = work.clusters[cen].gain_multiplier;
+}
+
+// Called at the start of each optimal_transfer to capture the centers after
+// any quick transfers or recomputation of the centroids.
+template<typename Dim_, typename Float_, typename Index_, typename Cluster_, typename Loss_>
+void prepare_centers(Dim_ ndim, Cluster_ ncenters, const Float_* centers, Workspace<Float_, Index_, Cluster_, Loss_>& work, int nthreads) {
+    size_t ntiles = (static_cast<size_t>(ncenters) + cluster_tile_size - 1) / cluster_tile_size;
+    work.packed_centers.resize(ntiles * packed_tile_size(ndim));
+    for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+        pack_center(ndim, cen, centers, work);
+    }
+    if (work.prune) {
+        internal::compute_center_distances(ndim, ncenters, centers, work.center_distances, nthreads);
+    }
+}
+
+// Called after each transfer in optimal_transfer, where only the centers and
+// multipliers of the source and destination clusters have changed. 
+template<typename Dim_, typename Float_, typename Index_, typename Cluster_, typename Loss_>
+void update_centers(Dim_ ndim, Cluster_ ncenters, Cluster_ l1, Cluster_ l2, const Float_* centers, Workspace<Float_, Index_, Cluster_, Loss_>& work) {
+    size_t long_ndim = ndim;
+    size_t long_ncenters = ncenters;
+    for (auto cen : { l1, l2 }) {
+        pack_center(ndim, cen, centers, work);
+        if (!work.prune) {
+            continue;
+        }
+        auto cen_ptr = centers + long_ndim * static_cast<size_t>(cen); // cast to avoid overflow.
+        auto cen_dist = work.center_distances.data() + long_ncenters * static_cast<size_t>(cen); // cast to avoid overflow.
+        for (Cluster_ other = 0; other < ncenters; ++other) {
+            if (other != cen) {
+                auto dist = internal::distance(cen_ptr, centers + long_ndim * static_cast<size_t>(other), ndim); // cast to avoid overflow.
+                cen_dist[other] = dist;
+                work.center_distances[long_ncenters * static_cast<size_t>(other) + static_cast<size_t>(cen)] = dist; // cast to avoid overflow.
+            }
+        }
+    }
+}
+
+// Relative tolerance for the triangle inequality in find_best_destination(),
+// which needs to be large enough to absorb the round-off error in the
+// computed distances; otherwise, a candidate might be pruned even though its
+// computed WCSS gain is (barely) lower than the current best. The error in a
+// squared distance computed by summing over 'ndim' terms is bounded by about
+// 'ndim * epsilon', and we add a generous safety factor on top of that.
+template<typename Float_, typename Dim_>
+Float_ pruning_tolerance(Dim_ ndim) {
+    return std::numeric_limits<Float_>::epsilon() * 8 * (static_cast<Float_>(ndim) + 4);
 }
 
 template<typename Float_>
@@ -248,12 +535,12 @@ constexpr Float_ big_number() {
     return 1e30; // Some very big number.
 }
 
-template<typename Dim_, typename Data_, typename Index_, typename Cluster_, typename Float_>
-void transfer_point(Dim_ ndim, const Data_* obs_ptr, Index_ obs_id, Cluster_ l1, Cluster_ l2, Float_* centers, Cluster_* best_cluster, Workspace<Float_, Index_, Cluster_>& work) {
+template<typename Dim_, typename Data_, typename Index_, typename Cluster_, typename Float_, typename Loss_>
+void transfer_point(Dim_ ndim, const Data_* obs_ptr, Index_ obs_id, Cluster_ l1, Cluster_ l2, Float_* centers, Cluster_* best_cluster, Workspace<Float_, Index_, Cluster_, Loss_>& work) {
     // Yes, casts to float are deliberate here, so that the
     // multipliers can be computed correctly.
-    Float_ al1 = work.cluster_sizes[l1], alw = al1 - 1;
-    Float_ al2 = work.cluster_sizes[l2], alt = al2 + 1;
+    Float_ al1 = work.clusters[l1].size, alw = al1 - 1;
+    Float_ al2 = work.clusters[l2].size, alt = al2 + 1;
 
     size_t long_ndim = ndim;
     auto copy1 = centers + static_cast<size_t>(l1) * long_ndim; // cast to avoid overflow.
@@ -264,16 +551,154 @@ void transfer_point(Dim_ ndim, const Data_* obs_ptr, Index_ obs_id, Cluster_ l1,
         *copy2 = (*copy2 * al2 + oval) / alt;
     }
 
-    --work.cluster_sizes[l1];
-    ++work.cluster_sizes[l2];
+    --work.clusters[l1].size;
+    ++work.clusters[l2].size;
+    ++work.clusters[l1].updates_since_recompute;
+    ++work.clusters[l2].updates_since_recompute;
 
-    work.gain_multiplier[l1] = alw / al1;
-    work.loss_multiplier[l1] = (alw > 1 ? alw / (alw - 1) : big_number<Float_>());
-    work.loss_multiplier[l2] = alt / al2;
-    work.gain_multiplier[l2] = alt / (alt + 1);
+    work.clusters[l1].gain_multiplier = alw / al1;
+    work.clusters[l1].loss_multiplier = (alw > 1 ? alw / (alw - 1) : big_number<Float_>());
+    work.clusters[l2].loss_multiplier = alt / al2;
+    work.clusters[l2].gain_multiplier = alt / (alt + 1);
 
     best_cluster[obs_id] = l2;
-    work.best_destination_cluster[obs_id] = l1;
+    work.best_destination(obs_id) = l1;
+}
+
+template<typename Data_, typename Float_, typename Cluster_, typename Dim_>
+Float_ squared_distance_from_cluster(Dim_ ndim, const Data_* obs_ptr, Cluster_ cen, const Float_* centers) {
+    auto cen_ptr = centers + static_cast<size_t>(ndim) * static_cast<size_t>(cen); // cast to avoid overflow.
+    return squared_distance_from_cluster(obs_ptr, cen_ptr, ndim);
+}
+
+// Returns the destination cluster with the minimum WCSS gain for observation
+// 'obs' in cluster 'l1', along with the gain itself. Candidates are collected
+// into tiles for squared_distance_from_clusters(). Ties are broken in favor of
+// the previous best destination and then the lowest cluster index, so the
+// order in which candidates are visited does not affect the result.
+//
+// We skip candidates where a lower bound on the WCSS gain is greater than the
+// current best. The triangle inequality gives us 'd(x, c) >= d(l1, c) - d(x, l1)',
+// where 'd(x, l1)' is the square root of 'l1_dist' and 'd(l1, c)' is taken
+// from the matrix of center-to-center distances. As the bound is shrunk to
+// account for round-off error, any pruned candidate must have a computed
+// gain that is strictly greater than the best, and so would not have been
+// chosen anyway; the result is exactly the same as without pruning.
+template<typename Data_, typename Float_, typename Index_, typename Cluster_, typename Dim_, typename Loss_>
+std::pair<Cluster_, Float_> find_best_destination(
+    Dim_ ndim,
+    const Data_* obs_ptr,
+    Index_ obs,
+    Cluster_ l1,
+    Float_ l1_dist,
+    Cluster_ ncenters,
+    const Float_* centers,
+    const Workspace<Float_, Index_, Cluster_, Loss_>& work,
+    bool all_live)
+{
+    size_t long_ndim = ndim;
+    auto l2 = work.best_destination(obs);
+    auto original_l2 = l2;
+    auto l2_ptr = centers + long_ndim * static_cast<size_t>(l2); // cast to avoid overflow.
+    auto wcss_gain = squared_distance_from_cluster(obs_ptr, l2_ptr, ndim) * work.clusters[l2].gain_multiplier;
+
+    auto consider = [&](Cluster_ cen, Float_ candidate) -> void {
+        if (candidate < wcss_gain || (candidate == wcss_gain && l2 != original_l2 && cen < l2)) {
+            wcss_gain = candidate;
+            l2 = cen;
+        }
+    };
+
+    auto tol = pruning_tolerance<Float_>(ndim);
+    Float_ l1_bound = std::sqrt(l1_dist) * (1 + tol);
+
+    auto l1_center_dist = work.center_distances.data() + static_cast<size_t>(ncenters) * static_cast<size_t>(l1); // cast to avoid overflow.
+    auto is_pruned = [&](Cluster_ cen, Float_ gain_multiplier) -> bool {
+        if (!work.prune) {
+            return false;
+        }
+        Float_ lower = l1_center_dist[cen] * (1 - tol) - l1_bound;
+        return lower > 0 && lower * lower * gain_multiplier > wcss_gain;
+    };
+
+    Cluster_ tile[cluster_tile_size];
+    const Float_* tile_ptrs[cluster_tile_size];
+    Float_ tile_distances[cluster_tile_size];
+    size_t tile_count = 0;
+    auto add_candidate = [&](Cluster_ cen) -> void {
+        if (cen == l1 || cen == original_l2 || is_pruned(cen, work.clusters[cen].gain_multiplier)) {
+            return;
+        }
+        tile[tile_count] = cen;
+        tile_ptrs[tile_count] = centers + long_ndim * static_cast<size_t>(cen); // cast to avoid overflow.
+        ++tile_count;
+        if (tile_count == cluster_tile_size) {
+            squared_distance_from_clusters(obs_ptr, tile_ptrs, ndim, tile_distances);
+            for (size_t t = 0; t < cluster_tile_size; ++t) {
+                consider(tile[t], tile_distances[t] * work.clusters[tile[t]].gain_multiplier);
+            }
+            tile_count = 0;
+        }
+    };
+
+    // If the current assigned cluster is live, we need to check all
+    // other clusters as potential transfer destinations, because the
+    // gain/loss comparison has changed. Otherwise, we only need to
+    // consider other live clusters as transfer destinations; the
+    // non-live clusters were already rejected as transfer destinations
+    // when compared to the current assigned cluster, so there's no
+    // point checking them again if they didn't change in the meantime.
+    //
+    // The exception is for the first call to optimal_transfer, where we
+    // consider all clusters as live (i.e., all_live = true). This is
+    // because no observation really knows its best transfer
+    // destination yet - the second-closest cluster is just a
+    // guesstimate - so we need to compute it exhaustively.
+    if (all_live || work.clusters[l1].history.is_live(obs)) { 
+        auto packed = work.packed_centers.data();
+        size_t tile_stride = packed_tile_size(ndim);
+        for (Cluster_ start = 0; start < ncenters; start += cluster_tile_size, packed += tile_stride) {
+            Cluster_ end = start + std::min(static_cast<size_t>(ncenters - start), cluster_tile_size);
+            auto packed_multipliers = packed + long_ndim * cluster_tile_size;
+
+            // Skipping the entire tile if all of its candidates can be pruned.
+            bool any_candidate = false;
+            for (Cluster_ cen = start; cen < end; ++cen) {
+                if (cen != l1 && cen != original_l2 && !is_pruned(cen, packed_multipliers[cen - start])) {
+                    any_candidate = true;
+                    break;
+                }
+            }
+            if (!any_candidate) {
+                continue;
+            }
+
+            squared_distance_from_packed_clusters(obs_ptr, packed, ndim, tile_distances);
+            for (Cluster_ cen = start; cen < end; ++cen) {
+                if (cen != l1 && cen != original_l2) {
+                    consider(cen, tile_distances[cen - start] * packed_multipliers[cen - start]);
+                }
+            }
+        }
+    } else {
+        for (auto cen : work.currently_live) {
+            add_candidate(cen);
+        }
+        for (const auto& prev : work.previously_live) {
+            if (prev.first <= obs) {
+                break;
+            }
+            if (!work.clusters[prev.second].history.changed_in_current_optimal_transfer()) {
+                add_candidate(prev.second);
+            }
+        }
+    }
+
+    for (size_t t = 0; t < tile_count; ++t) {
+        consider(tile[t], squared_distance_from_cluster(obs_ptr, tile_ptrs[t], ndim) * work.clusters[tile[t]].gain_multiplier);
+    }
+
+    return std::make_pair(l2, wcss_gain);
 }
 
 /* ALGORITHM AS 136.1  APPL. STATIST. (1979) VOL.28, NO.1
@@ -283,18 +708,19 @@ void transfer_point(Dim_ ndim, const Data_* obs_ptr, Index_ obs_id, Cluster_ l1,
  * maximum reduction in the within-cluster sum of squares. In this stage,
  * there is only one pass through the data.
  */
-template<class Matrix_, typename Cluster_, typename Float_>
-bool optimal_transfer(const Matrix_& data, Workspace<Float_, typename Matrix_::index_type, Cluster_>& work, Cluster_ ncenters, Float_* centers, Cluster_* best_cluster, bool all_live) {
+template<class Matrix_, typename Cluster_, typename Float_, typename Loss_>
+bool optimal_transfer(const Matrix_& data, Workspace<Float_, typename Matrix_::index_type, Cluster_, Loss_>& work, Cluster_ ncenters, Float_* centers, Cluster_* best_cluster, bool all_live, int nthreads) {
     auto nobs = data.num_observations();
     auto ndim = data.num_dimensions();
     auto matwork = data.create_workspace();
-    size_t long_ndim = ndim;
+    prepare_live_clusters(work);
+    prepare_centers(ndim, ncenters, centers, work, nthreads);
 
     for (decltype(nobs) obs = 0; obs < nobs; ++obs) { 
         ++work.optra_steps_since_last_transfer;
 
         auto l1 = best_cluster[obs];
-        if (work.cluster_sizes[l1] != 1) {
+        if (work.clusters[l1].size != 1) {
             auto obs_ptr = data.get_observation(obs, matwork);
 
             // The original Fortran implementation re-used the WCSS loss for
@@ -306,61 +732,24 @@ bool optimal_transfer(const Matrix_& data, Workspace<Float_, typename Matrix_::i
             // numerical errors, even after the centroids are freshly
             // recomputed in the run() loop. So, we simplify matters and
             // improve accuracy by just recomputing the loss all the time,
-            // which doesn't take too much extra effort.
-            auto& wcss_loss = work.wcss_loss[obs];
-            auto l1_ptr = centers + long_ndim * static_cast<size_t>(l1); // cast to avoid overflow.
-            wcss_loss = squared_distance_from_cluster(obs_ptr, l1_ptr, ndim) * work.loss_multiplier[l1];
-
-            // Find the cluster with minimum WCSS gain.
-            auto l2 = work.best_destination_cluster[obs];
-            auto original_l2 = l2;
-            auto l2_ptr = centers + long_ndim * static_cast<size_t>(l2); // cast to avoid overflow.
-            auto wcss_gain = squared_distance_from_cluster(obs_ptr, l2_ptr, ndim) * work.gain_multiplier[l2];
-
-            auto update_destination_cluster = [&](Cluster_ cen) {
-                auto cen_ptr = centers + long_ndim * static_cast<size_t>(cen); // cast to avoid overflow.
-                auto candidate = squared_distance_from_cluster(obs_ptr, cen_ptr, ndim) * work.gain_multiplier[cen];
-                if (candidate < wcss_gain) {
-                    wcss_gain = candidate;
-                    l2 = cen;
-                }
-            };
-
-            // If the current assigned cluster is live, we need to check all
-            // other clusters as potential transfer destinations, because the
-            // gain/loss comparison has changed. Otherwise, we only need to
-            // consider other live clusters as transfer destinations; the
-            // non-live clusters were already rejected as transfer destinations
-            // when compared to the current assigned cluster, so there's no
-            // point checking them again if they didn't change in the meantime.
-            //
-            // The exception is for the first call to optimal_transfer, where we
-            // consider all clusters as live (i.e., all_live = true). This is
-            // because no observation really knows its best transfer
-            // destination yet - the second-closest cluster is just a
-            // guesstimate - so we need to compute it exhaustively.
-            if (all_live || work.update_history[l1].is_live(obs)) { 
-                for (Cluster_ cen = 0; cen < ncenters; ++cen) {
-                    if (cen != l1 && cen != original_l2) {
-                        update_destination_cluster(cen);
-                    }
-                }
-            } else {
-                for (Cluster_ cen = 0; cen < ncenters; ++cen) {
-                    if (cen != l1 && cen != original_l2 && work.update_history[cen].is_live(obs)) {
-                        update_destination_cluster(cen);
-                    }
-                }
-            }
+            // which doesn't take too much extra effort. We also use the
+            // full-precision loss here, even if the stored copy for the
+            // quick transfers has a lower precision.
+            auto l1_dist = squared_distance_from_cluster(ndim, obs_ptr, l1, centers);
+            Float_ wcss_loss = l1_dist * work.clusters[l1].loss_multiplier;
+            work.wcss_loss(obs) = wcss_loss;
+            auto dest = find_best_destination(ndim, obs_ptr, obs, l1, l1_dist, ncenters, centers, work, all_live);
 
             // Deciding whether to make the transfer based on the change to the WCSS.
-            if (wcss_gain >= wcss_loss) {
-                work.best_destination_cluster[obs] = l2;
+            auto l2 = dest.first;
+            if (dest.second >= wcss_loss) {
+                work.best_destination(obs) = l2;
             } else {
                 work.optra_steps_since_last_transfer = 0;
-                work.update_history[l1].set_optimal(obs);
-                work.update_history[l2].set_optimal(obs);
+                set_optimal(work, l1, obs);
+                set_optimal(work, l2, obs);
                 transfer_point(ndim, obs_ptr, obs, l1, l2, centers, best_cluster, work);
+                update_centers(ndim, ncenters, l1, l2, centers, work);
             }
         }
 
@@ -374,6 +763,138 @@ bool optimal_transfer(const Matrix_& data, Workspace<Float_, typename Matrix_::i
     return false;
 } 
 
+/*
+ * Parallel version of optimal_transfer() that gives exactly the same results.
+ * We process the observations in blocks, where the best destination and the
+ * WCSS loss of each observation in a block are speculatively computed in
+ * parallel against the current state of the centers. The transfers are then
+ * committed serially in the original order of observations. For each
+ * observation, the speculative results are only invalidated by transfers
+ * involving earlier observations in the same block, so we keep track of
+ * the clusters that were touched by those transfers:
+ *
+ * - If the observation's own cluster, its previous best destination or its
+ *   speculative best destination was touched, we just repeat the evaluation
+ *   from scratch with the current centers.
+ * - Otherwise, the WCSS loss is unchanged, as are the gains for all untouched
+ *   clusters. The only remaining candidates are the touched clusters, which
+ *   must now be live (as they were updated in this pass) and whose gains are
+ *   recomputed and compared to the speculative best. Ties are broken in the
+ *   same manner as the serial loop, i.e., favoring the previous destination
+ *   and then the lowest cluster index.
+ *
+ * This is efficient when transfers are rare, which is typically the case
+ * after the first few iterations. Otherwise, when most clusters are touched in
+ * each block, we end up doing most of the work twice. 
+ */
+template<class Matrix_, typename Cluster_, typename Float_, typename Loss_>
+bool optimal_transfer_parallel(const Matrix_& data, Workspace<Float_, typename Matrix_::index_type, Cluster_, Loss_>& work, Cluster_ ncenters, Float_* centers, Cluster_* best_cluster, bool all_live, int nthreads) {
+    auto nobs = data.num_observations();
+    auto ndim = data.num_dimensions();
+    auto matwork = data.create_workspace();
+    size_t long_ndim = ndim;
+
+    typedef decltype(nobs) Index_;
+    constexpr Index_ block_size_per_thread = 256;
+    Index_ block_size = std::min(static_cast<size_t>(nobs), static_cast<size_t>(block_size_per_thread) * static_cast<size_t>(std::max(nthreads, 1))); // cast to avoid overflow.
+    std::vector<Cluster_> speculative_destination(block_size);
+    std::vector<Float_> speculative_gain(block_size), speculative_loss(block_size);
+
+    prepare_live_clusters(work);
+    prepare_centers(ndim, ncenters, centers, work, nthreads);
+
+    std::vector<uint8_t> touched(ncenters);
+    std::vector<Cluster_> touched_list;
+    touched_list.reserve(ncenters);
+    auto touch = [&](Cluster_ cen) -> void {
+        if (!touched[cen]) {
+            touched[cen] = 1;
+            touched_list.push_back(cen);
+        }
+    };
+
+    for (Index_ block_start = 0; block_start < nobs; block_start += block_size) {
+        Index_ block_length = std::min(block_size, static_cast<Index_>(nobs - block_start));
+
+        parallelize(nthreads, block_length, [&](int, Index_ start, Index_ length) -> void {
+            auto pwork = data.create_workspace(block_start + start, length);
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                auto obs_ptr = data.get_observation(pwork);
+                Index_ obs = block_start + i;
+                auto l1 = best_cluster[obs];
+                if (work.clusters[l1].size != 1) {
+                    auto l1_dist = squared_distance_from_cluster(ndim, obs_ptr, l1, centers);
+                    speculative_loss[i] = l1_dist * work.clusters[l1].loss_multiplier;
+                    auto dest = find_best_destination(ndim, obs_ptr, obs, l1, l1_dist, ncenters, centers, work, all_live);
+                    speculative_destination[i] = dest.first;
+                    speculative_gain[i] = dest.second;
+                }
+            }
+        });
+
+        for (Index_ i = 0; i < block_length; ++i) {
+            Index_ obs = block_start + i;
+            ++work.optra_steps_since_last_transfer;
+
+            auto l1 = best_cluster[obs];
+            if (work.clusters[l1].size != 1) {
+                const typename Matrix_::data_type* obs_ptr = NULL;
+                auto original_l2 = work.best_destination(obs);
+                auto l2 = speculative_destination[i];
+                auto wcss_gain = speculative_gain[i];
+                auto wcss_loss = speculative_loss[i];
+
+                if (touched[l1] || touched[original_l2] || touched[l2]) {
+                    obs_ptr = data.get_observation(obs, matwork);
+                    auto l1_dist = squared_distance_from_cluster(ndim, obs_ptr, l1, centers);
+                    wcss_loss = l1_dist * work.clusters[l1].loss_multiplier;
+                    auto dest = find_best_destination(ndim, obs_ptr, obs, l1, l1_dist, ncenters, centers, work, all_live);
+                    l2 = dest.first;
+                    wcss_gain = dest.second;
+
+                } else if (!touched_list.empty()) {
+                    obs_ptr = data.get_observation(obs, matwork);
+                    for (auto cen : touched_list) {
+                        auto cen_ptr = centers + long_ndim * static_cast<size_t>(cen); // cast to avoid overflow.
+                        auto candidate = squared_distance_from_cluster(obs_ptr, cen_ptr, ndim) * work.clusters[cen].gain_multiplier;
+                        if (candidate < wcss_gain || (candidate == wcss_gain && l2 != original_l2 && cen < l2)) {
+                            wcss_gain = candidate;
+                            l2 = cen;
+                        }
+                    }
+                }
+
+                work.wcss_loss(obs) = wcss_loss;
+                if (wcss_gain >= wcss_loss) {
+                    work.best_destination(obs) = l2;
+                } else {
+                    if (obs_ptr == NULL) {
+                        obs_ptr = data.get_observation(obs, matwork);
+                    }
+                    work.optra_steps_since_last_transfer = 0;
+                    set_optimal(work, l1, obs);
+                    set_optimal(work, l2, obs);
+                    transfer_point(ndim, obs_ptr, obs, l1, l2, centers, best_cluster, work);
+                    update_centers(ndim, ncenters, l1, l2, centers, work);
+                    touch(l1);
+                    touch(l2);
+                }
+            }
+
+            if (work.optra_steps_since_last_transfer == nobs) {
+                return true;
+            }
+        }
+
+        for (auto cen : touched_list) {
+            touched[cen] = 0;
+        }
+        touched_list.clear();
+    }
+
+    return false;
+} 
+
 /* ALGORITHM AS 136.2  APPL. STATIST. (1979) VOL.28, NO.1 
  * This is the Quick TRANsfer stage. 
  *             -------------------- 
@@ -385,10 +906,10 @@ bool optimal_transfer(const Matrix_& data, Workspace<Float_, typename Matrix_::i
  * step. In this stage, we loop through the data until no further change is to
  * take place, or we hit an iteration limit, whichever is first.
  */
-template<class Matrix_, typename Cluster_, typename Float_>
+template<class Matrix_, typename Cluster_, typename Float_, typename Loss_>
 std::pair<bool, bool> quick_transfer(
     const Matrix_& data,
-    Workspace<Float_, typename Matrix_::index_type, Cluster_>& work,
+    Workspace<Float_, typename Matrix_::index_type, Cluster_, Loss_>& work,
     Float_* centers,
     Cluster_* best_cluster,
     int quick_iterations)
@@ -410,7 +931,7 @@ std::pair<bool, bool> quick_transfer(
             ++steps_since_last_quick_transfer;
             auto l1 = best_cluster[obs];
 
-            if (work.cluster_sizes[l1] != 1) {
+            if (work.clusters[l1].size != 1) {
                 const typename Matrix_::data_type* obs_ptr = NULL;
 
                 // Need to update the WCSS loss if the cluster was updated recently. 
@@ -420,27 +941,27 @@ std::pair<bool, bool> quick_transfer(
                 // Note that we use changed_at_or_after; if the same
                 // observation was changed in the previous iteration of the
                 // outermost loop, its WCSS loss won't have been updated yet.
-                auto& history1 = work.update_history[l1];
+                auto& history1 = work.clusters[l1].history;
                 if (history1.changed_after_or_at(prev_it, obs)) {
                     auto l1_ptr = centers + static_cast<size_t>(l1) * long_ndim; // cast to avoid overflow.
                     obs_ptr = data.get_observation(obs, matwork);
-                    work.wcss_loss[obs] = squared_distance_from_cluster(obs_ptr, l1_ptr, ndim) * work.loss_multiplier[l1];
+                    work.wcss_loss(obs) = squared_distance_from_cluster(obs_ptr, l1_ptr, ndim) * work.clusters[l1].loss_multiplier;
                 }
 
                 // If neither the best or second-best clusters have changed
                 // after the previous iteration that we visited this
                 // observation, then there's no point reevaluating the
                 // transfer, because nothing's going to be different anyway.
-                auto l2 = work.best_destination_cluster[obs];
-                auto& history2 = work.update_history[l2];
+                auto l2 = work.best_destination(obs);
+                auto& history2 = work.clusters[l2].history;
                 if (history1.changed_after(prev_it, obs) || history2.changed_after(prev_it, obs)) {
                     if (obs_ptr == NULL) {
                         obs_ptr = data.get_observation(obs, matwork);
                     }
                     auto l2_ptr = centers + static_cast<size_t>(l2) * long_ndim; // cast to avoid overflow.
-                    auto wcss_gain = squared_distance_from_cluster(obs_ptr, l2_ptr, ndim) * work.gain_multiplier[l2];
+                    auto wcss_gain = squared_distance_from_cluster(obs_ptr, l2_ptr, ndim) * work.clusters[l2].gain_multiplier;
 
-                    if (wcss_gain < work.wcss_loss[obs]) {
+                    if (wcss_gain < work.wcss_loss(obs)) {
                         had_transfer = true;
                         steps_since_last_quick_transfer = 0;
                         history1.set_quick(it, obs);
@@ -461,6 +982,64 @@ std::pair<bool, bool> quick_transfer(
     return std::make_pair(had_transfer, true);
 }
 
+template<typename Float_, typename Index_, typename Cluster_, typename Loss_>
+bool needs_recomputation(
+    const Workspace<Float_, Index_, Cluster_, Loss_>& work,
+    int iter,
+    CentroidRecomputation policy,
+    int interval,
+    int max_updates)
+{
+    switch (policy) {
+        case CentroidRecomputation::EVERY_ITERATION:
+            return true;
+        case CentroidRecomputation::PERIODIC:
+            return interval <= 1 || iter % interval == 0;
+        default: {
+            Index_ limit = std::max(max_updates, 0);
+            for (const auto& cl : work.clusters) {
+                if (cl.updates_since_recompute > limit) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+}
+
+// Recomputes the centroids from scratch, returning the maximum absolute
+// difference from the incrementally updated coordinates if 'drift' is
+// non-NULL. The contents of 'drift' are used as a buffer.
+template<class Matrix_, typename Float_, typename Index_, typename Cluster_, typename Loss_>
+Float_ recompute_centroids(
+    const Matrix_& data,
+    Cluster_ ncenters,
+    Float_* centers,
+    const Cluster_* clusters,
+    Workspace<Float_, Index_, Cluster_, Loss_>& work,
+    std::vector<Float_>* drift,
+    int nthreads)
+{
+    size_t total = static_cast<size_t>(data.num_dimensions()) * static_cast<size_t>(ncenters); // cast to avoid overflow.
+    if (drift) {
+        drift->resize(total);
+        std::copy_n(centers, total, drift->begin());
+    }
+
+    internal::compute_centroids(data, ncenters, centers, clusters, work.cluster_sizes(), nthreads);
+    for (auto& cl : work.clusters) {
+        cl.updates_since_recompute = 0;
+    }
+
+    Float_ max_drift = 0;
+    if (drift) {
+        for (size_t i = 0; i < total; ++i) {
+            max_drift = std::max(max_drift, std::abs((*drift)[i] - centers[i]));
+        }
+    }
+    return max_drift;
+}
+
 }
 /**
  * @endcond
@@ -528,24 +1107,46 @@ public:
             return internal::process_edge_case(data, ncenters, centers, clusters);
         }
 
-        RefineHartiganWong_internal::Workspace<Float_, Index_, Cluster_> work(nobs, ncenters);
+        if (my_options.float_wcss_loss) {
+            return run_internal<float>(data, ncenters, centers, clusters);
+        } else {
+            return run_internal<Float_>(data, ncenters, centers, clusters);
+        }
+    }
+
+private:
+    template<typename Loss_>
+    Details<Index_> run_internal(const Matrix_& data, Cluster_ ncenters, Float_* centers, Cluster_* clusters) const {
+        auto nobs = data.num_observations();
+        RefineHartiganWong_internal::Workspace<Float_, Index_, Cluster_, Loss_> work(nobs, ncenters);
+        work.prune = my_options.prune_optimal_transfer;
 
-        RefineHartiganWong_internal::find_closest_two_centers(data, ncenters, centers, clusters, work.best_destination_cluster, my_options.num_threads);
+        auto strategy = RefineHartiganWong_internal::find_closest_two_centers(data, ncenters, centers, clusters, work, my_options.assignment_strategy, my_options.num_threads);
         for (Index_ obs = 0; obs < nobs; ++obs) {
-            ++work.cluster_sizes[clusters[obs]];
+            ++work.clusters[clusters[obs]].size;
         }
-        internal::compute_centroids(data, ncenters, centers, clusters, work.cluster_sizes);
+        internal::compute_centroids(data, ncenters, centers, clusters, work.cluster_sizes(), my_options.num_threads);
 
         for (Cluster_ cen = 0; cen < ncenters; ++cen) {
-            Float_ num = work.cluster_sizes[cen]; // yes, cast is deliberate here so that the multipliers can be computed correctly.
-            work.gain_multiplier[cen] = num / (num + 1);
-            work.loss_multiplier[cen] = (num > 1 ? num / (num - 1) : RefineHartiganWong_internal::big_number<Float_>());
+            Float_ num = work.clusters[cen].size; // yes, cast is deliberate here so that the multipliers can be computed correctly.
+            work.clusters[cen].gain_multiplier = num / (num + 1);
+            work.clusters[cen].loss_multiplier = (num > 1 ? num / (num - 1) : RefineHartiganWong_internal::big_number<Float_>());
         }
 
+        std::vector<Float_> drift_buffer;
+        auto drift_ptr = (my_options.report_centroid_drift ? &drift_buffer : NULL);
+        Float_ max_drift = 0;
+
         int iter = 0;
         int ifault = 0;
         while ((++iter) <= my_options.max_iterations) {
-            bool finished = RefineHartiganWong_internal::optimal_transfer(data, work, ncenters, centers, clusters, /* all_live = */ (iter == 1));
+            bool all_live = (iter == 1);
+            bool finished;
+            if (my_options.parallel_optimal_transfer) {
+                finished = RefineHartiganWong_internal::optimal_transfer_parallel(data, work, ncenters, centers, clusters, all_live, my_options.num_threads);
+            } else {
+                finished = RefineHartiganWong_internal::optimal_transfer(data, work, ncenters, centers, clusters, all_live, my_options.num_threads);
+            }
             if (finished) {
                 break;
             }
@@ -564,7 +1165,16 @@ public:
             // cancellation error). Note that we don't have to do this if
             // 'finished = true' as this means that there was no transfer of
             // any kind in the final pass through the dataset.
-            internal::compute_centroids(data, ncenters, centers, clusters, work.cluster_sizes);
+            if (RefineHartiganWong_internal::needs_recomputation(
+                work,
+                iter,
+                my_options.centroid_recomputation,
+                my_options.centroid_recomputation_interval,
+                my_options.centroid_recomputation_max_updates
+            )) {
+                auto drift = RefineHartiganWong_internal::recompute_centroids(data, ncenters, centers, clusters, work, drift_ptr, my_options.num_threads);
+                max_drift = std::max(max_drift, drift);
+            }
 
             if (quick_status.second) { // Hit the quick transfer iteration limit.
                 if (my_options.quit_on_quick_transfer_convergence_failure) {
@@ -584,7 +1194,7 @@ public:
             }
 
             for (Cluster_ c = 0; c < ncenters; ++c) {
-                work.update_history[c].reset(nobs);
+                work.clusters[c].history.reset(nobs);
             }
         }
 
@@ -592,7 +1202,20 @@ public:
             ifault = 2;
         }
 
-        return Details(std::move(work.cluster_sizes), iter, ifault);
+        // Making sure that the reported centroids are exact, if we skipped
+        // the recomputation after the last set of transfers.
+        for (const auto& cl : work.clusters) {
+            if (cl.updates_since_recompute) {
+                auto drift = RefineHartiganWong_internal::recompute_centroids(data, ncenters, centers, clusters, work, drift_ptr, my_options.num_threads);
+                max_drift = std::max(max_drift, drift);
+                break;
+            }
+        }
+
+        Details<Index_> output(work.cluster_sizes(), iter, ifault);
+        output.assignment_strategy = strategy;
+        output.max_centroid_drift = max_drift;
+        return output;
     }
 };
 
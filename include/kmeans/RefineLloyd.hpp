@@ -6,7 +6,8 @@
 
 #include "Refine.hpp"
 #include "Details.hpp"
-#include "QuickSearch.hpp"
+#include "CenterSearch.hpp"
+#include "AssignmentStrategy.hpp"
 #include "is_edge_case.hpp"
 #include "compute_centroids.hpp"
 #include "parallelize.hpp"
@@ -29,6 +30,21 @@ struct RefineLloydOptions {
      */
     int max_iterations = 10;
 
+    /**
+     * Number of iterations between full recomputations of the centroids.
+     * In the intervening iterations, the centroids are updated incrementally by only adding or subtracting the observations that changed clusters.
+     * This is much faster in later iterations where few observations are reassigned, 
+     * but accumulates some floating-point error that is only eliminated at the next full recomputation.
+     * If this is 1 or less, the centroids are fully recomputed in every iteration.
+     */
+    int centroid_recompute_interval = 1;
+
+    /**
+     * Strategy for assigning each observation to its closest center.
+     * The strategy that was actually used is reported in `Details::assignment_strategy`.
+     */
+    AssignmentStrategy assignment_strategy = AssignmentStrategy::AUTOMATIC;
+
     /**
      * Number of threads to use.
      * The parallelization scheme is defined by `parallelize()`.
@@ -95,18 +111,52 @@ public:
         std::vector<Index_> sizes(ncenters);
         std::vector<Cluster_> copy(nobs);
         auto ndim = data.num_dimensions();
-        internal::QuickSearch<Float_, Cluster_, decltype(ndim)> index;
+        internal::CenterSearch<Float_, Cluster_, decltype(ndim)> index(my_options.assignment_strategy, nobs, ncenters, ndim, my_options.num_threads);
+
+        // Running sums are only required for incremental updates.
+        bool incremental = my_options.centroid_recompute_interval > 1;
+        std::vector<Float_> sums;
+        std::vector<Index_> changed;
+        if (incremental) {
+            sums.resize(static_cast<size_t>(ndim) * static_cast<size_t>(ncenters)); // cast to avoid overflow.
+        }
 
         for (iter = 1; iter <= my_options.max_iterations; ++iter) {
-            index.reset(ndim, ncenters, centers);
+            index.update(ndim, ncenters, centers);
             parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
                 auto work = data.create_workspace(start, length);
-                for (Index_ obs = start, end = start + length; obs < end; ++obs) {
-                    auto dptr = data.get_observation(work);
-                    copy[obs] = index.find(dptr); 
-                }
+                auto swork = index.create_workspace();
+                index.find(
+                    swork,
+                    length,
+                    [&]() -> auto { return data.get_observation(work); },
+                    [&](Index_ i, Cluster_ best) -> void { copy[start + i] = best; }
+                );
             });
 
+            // The first iteration always involves a full computation, as we
+            // don't know anything about the input contents of 'clusters'.
+            if (incremental && (iter - 1) % my_options.centroid_recompute_interval != 0) {
+                changed.clear();
+                for (Index_ obs = 0; obs < nobs; ++obs) {
+                    if (copy[obs] != clusters[obs]) {
+                        changed.push_back(obs);
+                    }
+                }
+                if (changed.empty()) {
+                    break;
+                }
+
+                internal::update_centroid_sums(data, sums.data(), changed, static_cast<const Cluster_*>(clusters), static_cast<const Cluster_*>(copy.data()));
+                for (auto obs : changed) {
+                    --sizes[clusters[obs]];
+                    ++sizes[copy[obs]];
+                    clusters[obs] = copy[obs];
+                }
+                internal::compute_centroids_from_sums(ndim, ncenters, sums.data(), centers, sizes);
+                continue;
+            }
+
             // Checking if it already converged.
             bool updated = false;
             for (Index_ obs = 0; obs < nobs; ++obs) {
@@ -124,14 +174,22 @@ public:
             for (Index_ obs = 0; obs < nobs; ++obs) {
                 ++sizes[clusters[obs]];
             }
-            internal::compute_centroids(data, ncenters, centers, clusters, sizes);
+
+            if (incremental) {
+                internal::compute_centroid_sums(data, ncenters, sums.data(), clusters, my_options.num_threads);
+                internal::compute_centroids_from_sums(ndim, ncenters, sums.data(), centers, sizes);
+            } else {
+                internal::compute_centroids(data, ncenters, centers, clusters, sizes, my_options.num_threads);
+            }
         }
 
         if (iter == my_options.max_iterations + 1) {
             status = 2;
         }
 
-        return Details<Index_>(std::move(sizes), iter, status);
+        Details<Index_> output(std::move(sizes), iter, status);
+        output.assignment_strategy = index.get_strategy();
+        return output;
     }
 };
 
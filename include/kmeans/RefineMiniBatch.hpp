@@ -4,6 +4,7 @@
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include <cstdint>
 #include <stdexcept>
 #include <limits>
@@ -14,7 +15,10 @@
 
 #include "Refine.hpp"
 #include "Details.hpp"
-#include "QuickSearch.hpp"
+#include "CenterSearch.hpp"
+#include "AssignmentStrategy.hpp"
+#include "compute_centroids.hpp"
+#include "assign.hpp"
 #include "is_edge_case.hpp"
 #include "parallelize.hpp"
 
@@ -26,6 +30,22 @@
 
 namespace kmeans {
 
+/**
+ * Final pass over all observations after the mini-batch iterations in `RefineMiniBatch`.
+ *
+ * - `FULL` assigns each observation to its closest centroid and then recomputes each centroid as the mean of its assigned observations.
+ * - `ASSIGN_ONLY` assigns each observation to its closest centroid, but returns the centroids from the mini-batch iterations without recomputing them.
+ *   This avoids a second pass through the dataset.
+ * - `NONE` skips the final pass altogether and only the centroids are meaningful on return.
+ *   The cluster assignments are only defined for the observations that were sampled in the mini-batch iterations, and may be stale.
+ *   Users can call `assign()` separately to obtain assignments for all observations, e.g., in a different process or on a different subset of the data.
+ */
+enum class MiniBatchFinalPass : char {
+    FULL,
+    ASSIGN_ONLY,
+    NONE
+};
+
 /** 
  * @brief Options for `RefineMiniBatch` construction.
  */
@@ -59,6 +79,40 @@ struct RefineMiniBatchOptions {
      */
     uint64_t seed = 1234567890u;
 
+    /**
+     * Strategy for assigning each observation to its closest center.
+     * The strategy that was actually used is reported in `Details::assignment_strategy`.
+     */
+    AssignmentStrategy assignment_strategy = AssignmentStrategy::AUTOMATIC;
+
+    /**
+     * Whether to stream contiguous chunks of observations instead of sampling arbitrary observations for each mini-batch.
+     * If true, the observations are split into consecutive chunks of size `RefineMiniBatchOptions::batch_size`, and each mini-batch is the next chunk in a random permutation of the chunks.
+     * The permutation is regenerated after all chunks have been used.
+     * Each chunk is read with a `MockMatrix::ConsecutiveAccessWorkspace` and copied into a buffer, so only two chunks need to be held in memory at any time;
+     * if `RefineMiniBatchOptions::num_threads` is greater than 1, the next chunk is read by one thread while the others process the current chunk.
+     * This is useful when random access to observations is expensive, e.g., for on-disk matrices.
+     * However, it assumes that the observations are not ordered by cluster, otherwise each mini-batch will not be representative of the full dataset.
+     * The final assignment of all observations at the end of `RefineMiniBatch::run()` always reads contiguous ranges of observations, regardless of this option.
+     */
+    bool streaming = false;
+
+    /**
+     * Final pass to perform over all observations after the mini-batch iterations.
+     */
+    MiniBatchFinalPass final_pass = MiniBatchFinalPass::FULL;
+
+    /**
+     * Whether to sample the observations for each mini-batch in parallel across `RefineMiniBatchOptions::num_threads` threads.
+     * If true, each observation is assigned a pseudo-random key that is computed from the seed, the iteration and the observation index, i.e., a counter-based random stream;
+     * the mini-batch is then defined as the `RefineMiniBatchOptions::batch_size` observations with the smallest keys.
+     * This yields a simple random sample without replacement that does not depend on how the observations are partitioned across threads,
+     * so the results are exactly reproducible for any number of threads.
+     * However, the mini-batches will be different from those obtained with the default serial sampling, even with a single thread.
+     * This option is ignored if `RefineMiniBatchOptions::streaming = true`.
+     */
+    bool parallel_sampling = false;
+
     /** 
      * Number of threads to use.
      * The parallelization scheme is defined by `parallelize()`.
@@ -66,6 +120,330 @@ struct RefineMiniBatchOptions {
     int num_threads = 1;
 };
 
+/**
+ * @cond
+ */
+namespace RefineMiniBatch_internal {
+
+template<typename Index_, typename Cluster_>
+class CenterUpdater {
+public:
+    CenterUpdater(Cluster_ ncenters, int nthreads) {
+        if (nthreads > 1) {
+            my_batch_counts.resize(ncenters);
+            my_boundaries.resize(nthreads + 1);
+            my_owned.resize(nthreads);
+        }
+    }
+
+private:
+    std::vector<Index_> my_batch_counts;
+    std::vector<Cluster_> my_boundaries;
+    std::vector<std::vector<Index_> > my_owned;
+
+public:
+    // If 'buffer' is not NULL, it should contain the coordinates of all
+    // observations in 'chosen', which should be consecutive.
+    template<class Matrix_, typename Float_>
+    void run(
+        const Matrix_& data,
+        Cluster_ ncenters,
+        Float_* centers,
+        const Cluster_* clusters,
+        const std::vector<Index_>& chosen,
+        std::vector<uint64_t>& total_sampled,
+        const typename Matrix_::data_type* buffer,
+        int nthreads)
+    {
+        auto ndim = data.num_dimensions();
+        size_t long_ndim = ndim;
+        auto update = [&](Index_ o, const typename Matrix_::data_type* ocopy) -> void {
+            const auto c = clusters[o];
+            auto& n = total_sampled[c];
+            ++n;
+
+            Float_ mult = static_cast<Float_>(1)/static_cast<Float_>(n);
+            auto ccopy = centers + static_cast<size_t>(c) * long_ndim; // cast to avoid overflow.
+            for (decltype(ndim) d = 0; d < ndim; ++d, ++ocopy, ++ccopy) {
+                (*ccopy) += (static_cast<Float_>(*ocopy) - *ccopy) * mult; // cast to ensure consistent precision regardless of Matrix_::data_type.
+            }
+        };
+
+        auto update_all = [&](const std::vector<Index_>& sequence) -> void {
+            if (buffer) {
+                for (auto o : sequence) {
+                    update(o, buffer + static_cast<size_t>(o - chosen.front()) * long_ndim); // cast to avoid overflow.
+                }
+            } else {
+                auto work = data.create_workspace(sequence.data(), static_cast<Index_>(sequence.size()));
+                for (auto o : sequence) {
+                    update(o, data.get_observation(work));
+                }
+            }
+        };
+
+        Index_ batch_size = chosen.size();
+        if (nthreads <= 1) {
+            update_all(chosen);
+            return;
+        }
+
+        // Each thread takes ownership of a contiguous range of clusters,
+        // chosen so that each range has roughly the same number of
+        // observations in the batch. Each thread then updates its clusters
+        // with the observations in the same order as in 'chosen', which
+        // ensures that we get exactly the same results as the serial case.
+        std::fill(my_batch_counts.begin(), my_batch_counts.end(), 0);
+        for (auto o : chosen) {
+            ++my_batch_counts[clusters[o]];
+        }
+
+        my_boundaries[0] = 0;
+        Cluster_ cen = 0;
+        uint64_t accumulated = 0;
+        for (int t = 1; t < nthreads; ++t) {
+            uint64_t target = static_cast<uint64_t>(batch_size) * static_cast<uint64_t>(t) / static_cast<uint64_t>(nthreads);
+            while (cen < ncenters && accumulated < target) {
+                accumulated += my_batch_counts[cen];
+                ++cen;
+            }
+            my_boundaries[t] = cen;
+        }
+        my_boundaries[nthreads] = ncenters;
+
+        parallelize(nthreads, nthreads, [&](int, int start, int length) {
+            for (int t = start, end = start + length; t < end; ++t) {
+                auto first = my_boundaries[t], last = my_boundaries[t + 1];
+                if (first == last) {
+                    continue;
+                }
+
+                auto& mine = my_owned[t];
+                mine.clear();
+                for (auto o : chosen) {
+                    auto c = clusters[o];
+                    if (c >= first && c < last) {
+                        mine.push_back(o);
+                    }
+                }
+
+                update_all(mine);
+            }
+        });
+    }
+};
+
+/*
+ * Counter-based random stream, where each value is a function of the seed,
+ * the iteration and the observation index, based on the SplitMix64 mixer.
+ * This ensures that the random value for each observation does not depend
+ * on the order in which it is generated, e.g., across threads.
+ */
+inline uint64_t mix_bits(uint64_t x) {
+    x += 0x9e3779b97f4a7c15u;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9u;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebu;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t sampling_key(uint64_t seed, uint64_t iteration, uint64_t obs) {
+    return mix_bits(mix_bits(mix_bits(seed) + iteration) + obs);
+}
+
+/*
+ * Chooses the 'batch_size' observations with the smallest keys for this
+ * iteration. We only collect observations with keys below a threshold that
+ * should be exceeded by more than 'batch_size' observations, increasing the
+ * threshold in the rare cases where there are not enough observations.
+ * Ties are broken by the observation index, so the result is fully
+ * determined by the keys and is independent of the number of threads.
+ */
+template<typename Index_>
+class ParallelSampler {
+private:
+    std::vector<std::vector<std::pair<uint64_t, Index_> > > my_candidates;
+    std::vector<std::pair<uint64_t, Index_> > my_combined;
+
+public:
+    void run(Index_ nobs, Index_ batch_size, uint64_t seed, uint64_t iteration, std::vector<Index_>& chosen, int nthreads) {
+        chosen.resize(batch_size);
+        if (batch_size == 0) {
+            return;
+        }
+
+        my_candidates.resize(std::max(nthreads, 1));
+        double expected = batch_size;
+        double fraction = (expected + 4 * std::sqrt(expected) + 10) / static_cast<double>(nobs);
+
+        while (true) {
+            constexpr double max_key = static_cast<double>(std::numeric_limits<uint64_t>::max());
+            uint64_t threshold = (fraction >= 1 ? std::numeric_limits<uint64_t>::max() : static_cast<uint64_t>(fraction * max_key));
+
+            parallelize(nthreads, nobs, [&](int t, Index_ start, Index_ length) -> void {
+                auto& candidates = my_candidates[t];
+                candidates.clear();
+                for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                    auto key = sampling_key(seed, iteration, obs);
+                    if (key <= threshold) {
+                        candidates.emplace_back(key, obs);
+                    }
+                }
+            });
+
+            my_combined.clear();
+            for (const auto& candidates : my_candidates) {
+                my_combined.insert(my_combined.end(), candidates.begin(), candidates.end());
+            }
+            for (auto& candidates : my_candidates) {
+                candidates.clear();
+            }
+
+            if (my_combined.size() >= static_cast<size_t>(batch_size)) {
+                break;
+            }
+            fraction *= 2;
+        }
+
+        std::nth_element(my_combined.begin(), my_combined.begin() + (batch_size - 1), my_combined.end());
+        for (Index_ b = 0; b < batch_size; ++b) {
+            chosen[b] = my_combined[b].second;
+        }
+        std::sort(chosen.begin(), chosen.end());
+    }
+};
+
+/*
+ * Streams consecutive chunks of observations in a random order, where each
+ * chunk is copied into one of two buffers. The next chunk is loaded into the
+ * other buffer while the current chunk is being processed.
+ */
+template<typename Index_, typename Data_>
+class ChunkStreamer {
+private:
+    Index_ my_nobs = 0, my_chunk_size = 0;
+    size_t my_long_ndim = 0;
+    std::vector<Index_> my_order;
+    Index_ my_position = 0;
+
+    std::vector<Data_> my_buffers[2];
+    int my_current = 0;
+    bool my_swap = false;
+
+public:
+    template<class Matrix_, class Engine_>
+    void initialize(const Matrix_& data, Index_ chunk_size, Engine_& eng) {
+        my_nobs = data.num_observations();
+        my_long_ndim = data.num_dimensions();
+        my_chunk_size = chunk_size;
+
+        Index_ nchunks = my_nobs / chunk_size + (my_nobs % chunk_size > 0);
+        my_order.resize(nchunks);
+        std::iota(my_order.begin(), my_order.end(), static_cast<Index_>(0));
+        aarand::shuffle(my_order.begin(), my_order.size(), eng);
+        my_position = 0;
+
+        for (auto& buffer : my_buffers) {
+            buffer.resize(my_long_ndim * static_cast<size_t>(chunk_size)); // cast to avoid overflow.
+        }
+        my_current = 0;
+        load(data, my_order[0], my_buffers[0]);
+    }
+
+private:
+    std::pair<Index_, Index_> range(Index_ chunk) const {
+        Index_ start = chunk * my_chunk_size;
+        return std::make_pair(start, std::min(my_chunk_size, static_cast<Index_>(my_nobs - start)));
+    }
+
+    template<class Matrix_>
+    void load(const Matrix_& data, Index_ chunk, std::vector<Data_>& buffer) const {
+        auto rr = range(chunk);
+        auto work = data.create_workspace(rr.first, rr.second);
+        auto bptr = buffer.data();
+        for (Index_ i = 0; i < rr.second; ++i, bptr += my_long_ndim) {
+            auto optr = data.get_observation(work);
+            std::copy_n(optr, my_long_ndim, bptr);
+        }
+    }
+
+public:
+    void current(std::vector<Index_>& chosen) const {
+        auto rr = range(my_order[my_position]);
+        chosen.resize(rr.second);
+        std::iota(chosen.begin(), chosen.end(), rr.first);
+    }
+
+    const Data_* current_buffer() const {
+        return my_buffers[my_current].data();
+    }
+
+    // Calls 'fun' on ranges of the current chunk across threads. If
+    // 'load_next = true', the next chunk is also loaded by one of the
+    // threads. The order is reshuffled after all chunks have been used.
+    template<class Matrix_, class Engine_, class Function_>
+    void process(const Matrix_& data, int nthreads, bool load_next, Engine_& eng, Function_ fun) {
+        auto current_chunk = my_order[my_position];
+        Index_ length = range(current_chunk).second;
+        auto buffer = current_buffer();
+
+        my_swap = false;
+        Index_ next_chunk = current_chunk;
+        if (load_next) {
+            ++my_position;
+            if (static_cast<size_t>(my_position) == my_order.size()) {
+                aarand::shuffle(my_order.begin(), my_order.size(), eng);
+                my_position = 0;
+            }
+            next_chunk = my_order[my_position];
+            // No need to swap if the next chunk is the same as the current one, i.e., if there
+            // is only one chunk, or if the reshuffled order happens to start with the current chunk.
+            my_swap = (next_chunk != current_chunk);
+        }
+        auto& next_buffer = my_buffers[1 - my_current];
+
+        if (nthreads <= 1 || !my_swap) {
+            if (nthreads <= 1) {
+                fun(static_cast<Index_>(0), length, buffer);
+            } else {
+                parallelize(nthreads, length, [&](int, Index_ start, Index_ len) -> void {
+                    fun(start, len, buffer + static_cast<size_t>(start) * my_long_ndim); // cast to avoid overflow.
+                });
+            }
+            if (my_swap) {
+                load(data, next_chunk, next_buffer);
+            }
+            return;
+        }
+
+        // The first thread loads the next chunk while the others process the current chunk.
+        int nprocessors = nthreads - 1;
+        parallelize(nthreads, nthreads, [&](int, int start, int len) -> void {
+            for (int t = start, end = start + len; t < end; ++t) {
+                if (t == 0) {
+                    load(data, next_chunk, next_buffer);
+                    continue;
+                }
+                Index_ first = static_cast<uint64_t>(length) * static_cast<uint64_t>(t - 1) / static_cast<uint64_t>(nprocessors);
+                Index_ last = static_cast<uint64_t>(length) * static_cast<uint64_t>(t) / static_cast<uint64_t>(nprocessors);
+                if (first < last) {
+                    fun(first, static_cast<Index_>(last - first), buffer + static_cast<size_t>(first) * my_long_ndim); // cast to avoid overflow.
+                }
+            }
+        });
+    }
+
+    void advance() {
+        if (my_swap) {
+            my_current = 1 - my_current;
+        }
+    }
+};
+
+}
+/**
+ * @endcond
+ */
+
 /**
  * @brief Implements the mini-batch algorithm for k-means clustering.
  *
@@ -82,8 +460,16 @@ struct RefineMiniBatchOptions {
  * Specifically, every \f$h\f$ iterations, we compute the proportion of sampled observations for each cluster in the past \f$h\f$ mini-batches that were reassigned to/from that cluster.
  * If this proportion is less than some threshold \f$p\f$ for all clusters, we consider that the algorithm has converged.
  * 
+ * After the mini-batch iterations, all observations are assigned to their closest centroids and the centroids are recomputed from their assigned observations.
+ * This can be skipped or reduced with `RefineMiniBatchOptions::final_pass`, which is useful when only the centroids are of interest.
+ *
  * In the `Details::status` returned by `run()`, the status code is either 0 (success) or 2 (maximum iterations reached without convergence).
  * Previous versions of the library would report a status code of 1 upon encountering an empty cluster, but these are now just ignored.
+ * If `RefineMiniBatchOptions::final_pass = MiniBatchFinalPass::NONE`, all entries of `Details::sizes` are set to zero.
+ *
+ * The results are exactly reproducible for any `RefineMiniBatchOptions::num_threads` with the same seed.
+ * Each centroid is updated by a single thread that processes its assigned observations in the order of the mini-batch, so the order of floating-point operations does not depend on the number of threads.
+ * The mini-batches are sampled serially by default; for large datasets, `RefineMiniBatchOptions::parallel_sampling` can be used to sample in parallel without sacrificing reproducibility.
  *
  * @tparam Matrix_ Matrix type for the input data.
  * This should satisfy the `MockMatrix` contract.
@@ -131,46 +517,69 @@ public:
         Index_ actual_batch_size = nobs;
         typedef typename std::conditional<std::is_signed<Index_>::value, int, unsigned int>::type SafeCompInt; // waiting for C++20's comparison functions...
         if (static_cast<SafeCompInt>(actual_batch_size) > my_options.batch_size) {
-            actual_batch_size = my_options.batch_size;
+            actual_batch_size = std::max(my_options.batch_size, 0);
         }
         std::vector<Index_> chosen(actual_batch_size);
         std::mt19937_64 eng(my_options.seed);
+        RefineMiniBatch_internal::ChunkStreamer<Index_, typename Matrix_::data_type> streamer;
+        RefineMiniBatch_internal::ParallelSampler<Index_> sampler;
 
         auto ndim = data.num_dimensions();
-        size_t long_ndim = ndim;
-        internal::QuickSearch<Float_, Cluster_, decltype(ndim)> index;
+        RefineMiniBatch_internal::CenterUpdater<Index_, Cluster_> updater(ncenters, my_options.num_threads);
+        internal::CenterSearch<Float_, Cluster_, decltype(ndim)> index(my_options.assignment_strategy, actual_batch_size, ncenters, ndim, my_options.num_threads);
+
+        if (my_options.streaming) {
+            // Each chunk needs at least one observation to cover the dataset.
+            streamer.initialize(data, std::max(actual_batch_size, static_cast<Index_>(1)), eng);
+        }
 
         for (iter = 1; iter <= my_options.max_iterations; ++iter) {
-            aarand::sample(nobs, actual_batch_size, chosen.data(), eng);
+            if (my_options.streaming) {
+                streamer.current(chosen);
+            } else if (my_options.parallel_sampling) {
+                sampler.run(nobs, actual_batch_size, my_options.seed, iter, chosen, my_options.num_threads);
+            } else {
+                aarand::sample(nobs, actual_batch_size, chosen.data(), eng);
+            }
             if (iter > 1) {
                 for (auto o : chosen) {
                     previous[o] = clusters[o];
                 }
             }
 
-            index.reset(ndim, ncenters, centers);
-            parallelize(my_options.num_threads, actual_batch_size, [&](int, Index_ start, Index_ length) {
-                auto work = data.create_workspace(chosen.data() + start, length);
-                for (Index_ s = start, end = start + length; s < end; ++s) {
-                    auto ptr = data.get_observation(work);
-                    clusters[chosen[s]] = index.find(ptr);
-                }
-            });
+            index.update(ndim, ncenters, centers);
+            if (my_options.streaming) {
+                // Reading the next chunk while the current chunk is being processed.
+                streamer.process(data, my_options.num_threads, iter < my_options.max_iterations, eng, [&](Index_ start, Index_ length, const typename Matrix_::data_type* buffer) -> void {
+                    auto swork = index.create_workspace();
+                    index.find(
+                        swork,
+                        length,
+                        [&]() -> auto {
+                            auto ptr = buffer;
+                            buffer += ndim;
+                            return ptr;
+                        },
+                        [&](Index_ i, Cluster_ best) -> void { clusters[chosen[start + i]] = best; }
+                    );
+                });
+            } else {
+                parallelize(my_options.num_threads, actual_batch_size, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(chosen.data() + start, length);
+                    auto swork = index.create_workspace();
+                    index.find(
+                        swork,
+                        length,
+                        [&]() -> auto { return data.get_observation(work); },
+                        [&](Index_ i, Cluster_ best) -> void { clusters[chosen[start + i]] = best; }
+                    );
+                });
+            }
 
             // Updating the means for each cluster.
-            auto work = data.create_workspace(chosen.data(), actual_batch_size);
-            for (auto o : chosen) {
-                const auto c = clusters[o];
-                auto& n = total_sampled[c];
-                ++n;
-
-                Float_ mult = static_cast<Float_>(1)/static_cast<Float_>(n);
-                auto ccopy = centers + static_cast<size_t>(c) * long_ndim;
-                auto ocopy = data.get_observation(work);
-
-                for (decltype(ndim) d = 0; d < ndim; ++d, ++ocopy, ++ccopy) {
-                    (*ccopy) += (static_cast<Float_>(*ocopy) - *ccopy) * mult; // cast to ensure consistent precision regardless of Matrix_::data_type.
-                }
+            updater.run(data, ncenters, centers, clusters, chosen, total_sampled, (my_options.streaming ? streamer.current_buffer() : NULL), my_options.num_threads);
+            if (my_options.streaming) {
+                streamer.advance();
             }
 
             // Checking for updates.
@@ -208,23 +617,23 @@ public:
             status = 2;
         }
 
-        // Run through all observations to make sure they have the latest cluster assignments.
-        index.reset(ndim, ncenters, centers);
-        parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
-            auto work = data.create_workspace(start, length);
-            for (Index_ s = start, end = start + length; s < end; ++s) {
-                auto ptr = data.get_observation(work);
-                clusters[s] = index.find(ptr);
+        std::vector<Index_> cluster_sizes(ncenters);
+        if (my_options.final_pass != MiniBatchFinalPass::NONE) {
+            // Run through all observations to make sure they have the latest cluster assignments.
+            index.update(ndim, ncenters, centers);
+            internal::assign_all(data, index, clusters, my_options.num_threads);
+            for (Index_ o = 0; o < nobs; ++o) {
+                ++cluster_sizes[clusters[o]];
             }
-        });
 
-        std::vector<Index_> cluster_sizes(ncenters);
-        for (Index_ o = 0; o < nobs; ++o) {
-            ++cluster_sizes[clusters[o]];
+            if (my_options.final_pass == MiniBatchFinalPass::FULL) {
+                internal::compute_centroids(data, ncenters, centers, clusters, cluster_sizes, my_options.num_threads);
+            }
         }
 
-        internal::compute_centroids(data, ncenters, centers, clusters, cluster_sizes);
-        return Details<Index_>(std::move(cluster_sizes), iter, status);
+        Details<Index_> output(std::move(cluster_sizes), iter, status);
+        output.assignment_strategy = index.get_strategy();
+        return output;
     }
 };
 
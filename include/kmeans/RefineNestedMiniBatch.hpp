@@ -0,0 +1,445 @@
+#ifndef KMEANS_REFINE_NESTED_MINIBATCH_HPP
+#define KMEANS_REFINE_NESTED_MINIBATCH_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+
+#include "aarand/aarand.hpp"
+
+#include "Refine.hpp"
+#include "Details.hpp"
+#include "CenterSearch.hpp"
+#include "AssignmentStrategy.hpp"
+#include "compute_centroids.hpp"
+#include "compute_distances.hpp"
+#include "assign.hpp"
+#include "is_edge_case.hpp"
+#include "parallelize.hpp"
+
+/**
+ * @file RefineNestedMiniBatch.hpp
+ *
+ * @brief Implements the nested mini-batch algorithm for k-means clustering.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for `RefineNestedMiniBatch` construction.
+ */
+struct RefineNestedMiniBatchOptions {
+    /**
+     * Maximum number of iterations.
+     * More iterations increase the opportunity for convergence at the cost of more computational time.
+     */
+    int max_iterations = 100;
+
+    /**
+     * Number of observations in the initial mini-batch.
+     * This is doubled throughout the algorithm until it contains all observations.
+     */
+    int batch_size = 500;
+
+    /**
+     * Threshold on the ratio of the noise to the movement of each centroid (i.e., \f$\rho\f$ in the documentation for `RefineNestedMiniBatch`).
+     * Larger values delay the doubling of the mini-batch, favoring more iterations on smaller batches.
+     */
+    double noise_ratio = 1;
+
+    /**
+     * Seed to use for the PRNG when sampling observations to add to the mini-batch.
+     */
+    uint64_t seed = 1234567890u;
+
+    /**
+     * Strategy for assigning each observation to its closest center, if the algorithm does not converge and all observations need to be assigned at the end.
+     * The strategy that was actually used is reported in `Details::assignment_strategy`;
+     * this is left as `AssignmentStrategy::AUTOMATIC` if the algorithm converged and no final assignment was necessary.
+     */
+    AssignmentStrategy assignment_strategy = AssignmentStrategy::AUTOMATIC;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace RefineNestedMiniBatch_internal {
+
+/*
+ * Samples 'number' observations that are not already in 'batch', where the
+ * latter should be sorted and unique. The output is also sorted and unique.
+ */
+template<typename Index_, class Engine_>
+void sample_new_observations(Index_ nobs, const std::vector<Index_>& batch, Index_ number, std::vector<Index_>& output, Engine_& eng) {
+    output.resize(number);
+    aarand::sample(static_cast<Index_>(nobs - batch.size()), number, output.data(), eng);
+
+    // Converting ranks among the unsampled observations to observation indices.
+    size_t pos = 0, bsize = batch.size();
+    for (auto& r : output) {
+        Index_ candidate = r + pos;
+        while (pos < bsize && batch[pos] <= candidate) {
+            ++pos;
+            candidate = r + pos;
+        }
+        r = candidate;
+    }
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Implements the nested mini-batch algorithm for k-means clustering.
+ *
+ * The nested mini-batch algorithm is a variant of the mini-batch approach where each mini-batch is a superset of the previous one.
+ * Each iteration assigns the observations in the mini-batch to their closest centroids, and each centroid is then set to the mean of its assigned observations.
+ * As the mini-batches are nested, the assignment of each observation in the previous mini-batch can be re-used,
+ * along with Hamerly-style bounds on the distances to its closest and second-closest centroids (see `RefineHamerly`) to skip most distance calculations.
+ * The per-cluster sums are also updated incrementally for the observations that change their assignments.
+ * This avoids the redundant work of `RefineMiniBatch` where each iteration samples a new mini-batch and discards the results from previous iterations.
+ *
+ * The mini-batch size is doubled when the statistical noise in the centroids dominates their movement between iterations,
+ * i.e., further iterations on the current mini-batch are unlikely to improve the estimates of the population centroids.
+ * Specifically, for each cluster \f$j\f$, we compute the standard error \f$\sigma_j\f$ of its centroid from its assigned observations and the distance \f$p_j\f$ that the centroid moved in the last iteration.
+ * If \f$\sigma_j \ge \rho p_j\f$ for all \f$j\f$, the new observations are sampled without replacement from those not in the current mini-batch.
+ * Once the mini-batch contains all observations, the algorithm is equivalent to Lloyd's algorithm (see `RefineLloyd`) and converges when no observations change their assignments.
+ *
+ * In the `Details::status` returned by `run()`, the status code is either 0 (success) or 2 (maximum iterations reached without convergence).
+ * If the algorithm does not converge, all observations are assigned to their closest centroids before returning.
+ * In all cases, the returned centroids are computed from scratch from the final assignments.
+ *
+ * @tparam Matrix_ Matrix type for the input data.
+ * This should satisfy the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centroids.
+ *
+ * @see
+ * Newling, J. and Fleuret, F. (2016).
+ * Nested mini-batch k-means.
+ * _Advances in Neural Information Processing Systems_ 29, 1352-1360.
+ */
+template<typename Matrix_ = SimpleMatrix<double, int>, typename Cluster_ = int, typename Float_ = double>
+class RefineNestedMiniBatch : public Refine<Matrix_, Cluster_, Float_> {
+public:
+    /**
+     * @param options Further options for the nested mini-batch algorithm.
+     */
+    RefineNestedMiniBatch(RefineNestedMiniBatchOptions options) : my_options(std::move(options)) {}
+
+    /**
+     * Default constructor.
+     */
+    RefineNestedMiniBatch() = default;
+
+public:
+    /**
+     * @return Options for nested mini-batch partitioning,
+     * to be modified prior to calling `run()`.
+     */
+    RefineNestedMiniBatchOptions& get_options() {
+        return my_options;
+    }
+
+private:
+    RefineNestedMiniBatchOptions my_options;
+    typedef typename Matrix_::index_type Index_;
+
+    // Unlike compute_centroids_from_sums(), clusters without any observations
+    // in a partial mini-batch retain their current centroids, as they might
+    // still acquire observations after the mini-batch is expanded. Once the
+    // mini-batch contains all observations, we set empty clusters to zero
+    // for consistency with RefineLloyd.
+    template<typename Dim_>
+    static void compute_centroids(Dim_ ndim, Cluster_ ncenters, const Float_* sums, Float_* centers, const std::vector<Index_>& sizes, bool partial) {
+        if (!partial) {
+            internal::compute_centroids_from_sums(ndim, ncenters, sums, centers, sizes);
+            return;
+        }
+
+        size_t long_ndim = ndim;
+        for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+            auto s = sizes[cen];
+            if (s) {
+                auto offset = static_cast<size_t>(cen) * long_ndim; // cast to avoid overflow.
+                auto cursum = sums + offset;
+                auto curcenter = centers + offset;
+                for (Dim_ dim = 0; dim < ndim; ++dim) {
+                    curcenter[dim] = cursum[dim] / s;
+                }
+            }
+        }
+    }
+
+public:
+    Details<Index_> run(const Matrix_& data, Cluster_ ncenters, Float_* centers, Cluster_* clusters) const {
+        auto nobs = data.num_observations();
+        if (internal::is_edge_case(nobs, ncenters)) {
+            return internal::process_edge_case(data, ncenters, centers, clusters);
+        }
+
+        auto ndim = data.num_dimensions();
+        size_t long_ndim = ndim;
+        size_t long_ncenters = ncenters;
+        std::mt19937_64 eng(my_options.seed);
+
+        Index_ batch_size = nobs;
+        typedef typename std::conditional<std::is_signed<Index_>::value, int, unsigned int>::type SafeCompInt; // waiting for C++20's comparison functions...
+        if (static_cast<SafeCompInt>(batch_size) > my_options.batch_size) {
+            batch_size = std::max(my_options.batch_size, 1);
+        }
+
+        // Per-observation statistics are stored in the same order as the
+        // (sorted) observation indices in the mini-batch.
+        std::vector<Index_> batch, fresh;
+        std::vector<Cluster_> assigned, proposed;
+        std::vector<Float_> upper, lower;
+
+        // Per-cluster statistics for the observations in the mini-batch.
+        std::vector<Float_> sums(long_ndim * long_ncenters), sum_squares(ncenters); // cast to avoid overflow.
+        std::vector<Index_> sizes(ncenters);
+        std::vector<Float_> previous(sums.size()), drift(ncenters), closest_center;
+
+        // Finds the closest and second-closest centers from scratch.
+        auto search_all = [&](const typename Matrix_::data_type* dptr, Cluster_& best, Float_& best_dist, Float_& second_dist) -> void {
+            best = 0;
+            best_dist = std::numeric_limits<Float_>::max();
+            second_dist = std::numeric_limits<Float_>::max();
+            for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                auto dist = internal::distance(centers + static_cast<size_t>(cen) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                if (dist < best_dist) {
+                    second_dist = best_dist;
+                    best = cen;
+                    best_dist = dist;
+                } else if (dist < second_dist) {
+                    second_dist = dist;
+                }
+            }
+        };
+
+        // Adds observations to the mini-batch after searching for their closest centers.
+        std::vector<Index_> merged_batch;
+        std::vector<Cluster_> merged_assigned;
+        std::vector<Float_> merged_upper, merged_lower;
+
+        auto add_observations = [&](Index_ number) -> void {
+            RefineNestedMiniBatch_internal::sample_new_observations(nobs, batch, number, fresh, eng);
+            std::vector<Cluster_> fresh_assigned(number);
+            std::vector<Float_> fresh_upper(number), fresh_lower(number);
+
+            parallelize(my_options.num_threads, number, [&](int, Index_ start, Index_ length) {
+                auto work = data.create_workspace(fresh.data() + start, length);
+                for (Index_ i = start, end = start + length; i < end; ++i) {
+                    search_all(data.get_observation(work), fresh_assigned[i], fresh_upper[i], fresh_lower[i]);
+                }
+            });
+
+            auto work = data.create_workspace(fresh.data(), number);
+            for (Index_ i = 0; i < number; ++i) {
+                auto c = fresh_assigned[i];
+                auto dptr = data.get_observation(work);
+                auto sptr = sums.data() + static_cast<size_t>(c) * long_ndim; // cast to avoid overflow.
+                auto& ss = sum_squares[c];
+                for (decltype(ndim) d = 0; d < ndim; ++d) {
+                    Float_ val = dptr[d]; // cast for consistent precision regardless of Matrix_::data_type.
+                    sptr[d] += val;
+                    ss += val * val;
+                }
+                ++sizes[c];
+            }
+
+            // Merging the new observations into the mini-batch, preserving the sorted order.
+            size_t total = batch.size() + fresh.size();
+            merged_batch.resize(total);
+            merged_assigned.resize(total);
+            merged_upper.resize(total);
+            merged_lower.resize(total);
+
+            size_t old_pos = 0, new_pos = 0;
+            for (size_t i = 0; i < total; ++i) {
+                if (new_pos == fresh.size() || (old_pos < batch.size() && batch[old_pos] < fresh[new_pos])) {
+                    merged_batch[i] = batch[old_pos];
+                    merged_assigned[i] = assigned[old_pos];
+                    merged_upper[i] = upper[old_pos];
+                    merged_lower[i] = lower[old_pos];
+                    ++old_pos;
+                } else {
+                    merged_batch[i] = fresh[new_pos];
+                    merged_assigned[i] = fresh_assigned[new_pos];
+                    merged_upper[i] = fresh_upper[new_pos];
+                    merged_lower[i] = fresh_lower[new_pos];
+                    ++new_pos;
+                }
+            }
+
+            batch.swap(merged_batch);
+            assigned.swap(merged_assigned);
+            upper.swap(merged_upper);
+            lower.swap(merged_lower);
+        };
+
+        add_observations(batch_size);
+
+        int iter = 0, status = 0;
+        Index_ current_size = batch_size;
+        for (iter = 1; iter <= my_options.max_iterations; ++iter) {
+            std::copy(centers, centers + sums.size(), previous.begin());
+            compute_centroids(ndim, ncenters, sums.data(), centers, sizes, current_size < nobs);
+            internal::compute_center_drift(ndim, ncenters, previous.data(), centers, drift.data());
+
+            // Checking whether the noise in each centroid dominates its movement.
+            bool expand = true;
+            for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                Float_ n = sizes[cen];
+                if (n <= 1) {
+                    continue;
+                }
+                auto cptr = centers + static_cast<size_t>(cen) * long_ndim; // cast to avoid overflow.
+                Float_ residual = sum_squares[cen];
+                for (decltype(ndim) d = 0; d < ndim; ++d) {
+                    residual -= cptr[d] * cptr[d] * n;
+                }
+                Float_ noise = std::sqrt(std::max(residual, static_cast<Float_>(0)) / (n * (n - 1)));
+                if (noise < my_options.noise_ratio * drift[cen]) {
+                    expand = false;
+                    break;
+                }
+            }
+
+            // Reassigning the existing observations in the mini-batch.
+            internal::compute_closest_center_distances(ndim, ncenters, centers, closest_center, my_options.num_threads);
+
+            // The lower bound for each observation is shifted by the largest movement of any center other than its assigned center.
+            Cluster_ max_drift_cluster = 0;
+            Float_ max_drift = 0, second_max_drift = 0;
+            for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                if (drift[cen] > max_drift) {
+                    second_max_drift = max_drift;
+                    max_drift = drift[cen];
+                    max_drift_cluster = cen;
+                } else if (drift[cen] > second_max_drift) {
+                    second_max_drift = drift[cen];
+                }
+            }
+
+            proposed.resize(current_size);
+            parallelize(my_options.num_threads, current_size, [&](int, Index_ start, Index_ length) {
+                auto work = data.create_workspace(batch.data() + start, length);
+                for (Index_ i = start, end = start + length; i < end; ++i) {
+                    auto dptr = data.get_observation(work);
+
+                    auto best = assigned[i];
+                    proposed[i] = best;
+                    auto& best_dist = upper[i];
+                    best_dist += drift[best];
+                    auto& second_dist = lower[i];
+                    second_dist -= (best == max_drift_cluster ? second_max_drift : max_drift);
+
+                    auto threshold = std::max(closest_center[best] / 2, second_dist);
+                    if (best_dist <= threshold) {
+                        continue;
+                    }
+
+                    // Tightening the upper bound, which is often enough to avoid a full search.
+                    best_dist = internal::distance(centers + static_cast<size_t>(best) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                    if (best_dist <= threshold) {
+                        continue;
+                    }
+
+                    search_all(dptr, proposed[i], best_dist, second_dist);
+                }
+            });
+
+            fresh.clear();
+            for (Index_ i = 0; i < current_size; ++i) {
+                if (proposed[i] != assigned[i]) {
+                    fresh.push_back(batch[i]);
+                }
+            }
+
+            if (fresh.size()) {
+                auto work = data.create_workspace(fresh.data(), static_cast<Index_>(fresh.size()));
+                for (Index_ i = 0; i < current_size; ++i) {
+                    auto from = assigned[i], to = proposed[i];
+                    if (from == to) {
+                        continue;
+                    }
+
+                    auto dptr = data.get_observation(work);
+                    auto fptr = sums.data() + static_cast<size_t>(from) * long_ndim; // cast to avoid overflow.
+                    auto tptr = sums.data() + static_cast<size_t>(to) * long_ndim;
+                    Float_ ss = 0;
+                    for (decltype(ndim) d = 0; d < ndim; ++d) {
+                        Float_ val = dptr[d]; // cast for consistent precision regardless of Matrix_::data_type.
+                        fptr[d] -= val;
+                        tptr[d] += val;
+                        ss += val * val;
+                    }
+                    sum_squares[from] -= ss;
+                    sum_squares[to] += ss;
+                    --sizes[from];
+                    ++sizes[to];
+                    assigned[i] = to;
+                }
+            }
+
+            if (current_size == nobs) {
+                if (fresh.empty()) {
+                    break;
+                }
+            } else if (expand) {
+                Index_ extra = std::min(current_size, static_cast<Index_>(nobs - current_size));
+                add_observations(extra);
+                current_size += extra;
+            }
+        }
+
+        if (iter == my_options.max_iterations + 1) {
+            status = 2;
+        }
+
+        AssignmentStrategy strategy = AssignmentStrategy::AUTOMATIC;
+        if (current_size == nobs && status == 0) {
+            // All observations are in the mini-batch and their assignments are already up to date.
+            for (Index_ i = 0; i < current_size; ++i) {
+                clusters[batch[i]] = assigned[i];
+            }
+
+        } else {
+            // Otherwise, we run through all observations to make sure they have the latest cluster assignments.
+            compute_centroids(ndim, ncenters, sums.data(), centers, sizes, current_size < nobs);
+            internal::CenterSearch<Float_, Cluster_, decltype(ndim)> index(my_options.assignment_strategy, nobs, ncenters, ndim, my_options.num_threads);
+            index.update(ndim, ncenters, centers);
+            internal::assign_all(data, index, clusters, my_options.num_threads);
+            strategy = index.get_strategy();
+        }
+
+        // Recomputing the centroids from scratch to remove the numerical
+        // error that accumulates in the incrementally updated sums.
+        std::fill(sizes.begin(), sizes.end(), 0);
+        for (Index_ o = 0; o < nobs; ++o) {
+            ++sizes[clusters[o]];
+        }
+
+        internal::compute_centroids(data, ncenters, centers, clusters, sizes, my_options.num_threads);
+        Details<Index_> output(std::move(sizes), iter, status);
+        output.assignment_strategy = strategy;
+        return output;
+    }
+};
+
+}
+
+#endif
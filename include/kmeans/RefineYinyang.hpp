@@ -0,0 +1,352 @@
+#ifndef KMEANS_REFINE_YINYANG_HPP
+#define KMEANS_REFINE_YINYANG_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+#include "Refine.hpp"
+#include "Details.hpp"
+#include "SimpleMatrix.hpp"
+#include "is_edge_case.hpp"
+#include "compute_centroids.hpp"
+#include "compute_distances.hpp"
+#include "parallelize.hpp"
+#include "InitializeKmeanspp.hpp"
+#include "RefineLloyd.hpp"
+
+/**
+ * @file RefineYinyang.hpp
+ *
+ * @brief Implements the Yinyang accelerated Lloyd algorithm for k-means clustering.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for `RefineYinyang` construction.
+ */
+struct RefineYinyangOptions {
+    /**
+     * Maximum number of iterations.
+     * More iterations increase the opportunity for convergence at the cost of more computational time.
+     */
+    int max_iterations = 10;
+
+    /**
+     * Number of groups of centers.
+     * Larger values increase the effectiveness of the group filter at the cost of more memory, as one lower bound is stored per group for each observation.
+     * If zero, this is set to one-tenth of the number of centers (or 1, whichever is larger).
+     */
+    int num_groups = 0;
+
+    /**
+     * Maximum number of Lloyd iterations used to group the initial centers.
+     */
+    int group_iterations = 5;
+
+    /**
+     * Random seed for the **k-means++** initialization of the groups.
+     */
+    uint64_t seed = 1234567890u;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace RefineYinyang_internal {
+
+template<typename Cluster_, typename Float_, typename Dim_>
+std::vector<Cluster_> group_centers(Dim_ ndim, Cluster_ ncenters, const Float_* centers, Cluster_ ngroups, const RefineYinyangOptions& options) {
+    std::vector<Cluster_> groups(ncenters);
+    if (ngroups <= 1) {
+        return groups;
+    }
+
+    // Clustering the centers with our own k-means implementation.
+    typedef SimpleMatrix<Float_, Cluster_, Dim_> CenterMatrix;
+    CenterMatrix mat(ndim, ncenters, centers);
+
+    InitializeKmeansppOptions iopt;
+    iopt.seed = options.seed;
+    InitializeKmeanspp<CenterMatrix, Cluster_, Float_> init(iopt);
+    RefineLloydOptions ropt;
+    ropt.max_iterations = options.group_iterations;
+    RefineLloyd<CenterMatrix, Cluster_, Float_> refine(ropt);
+
+    std::vector<Float_> group_centers(static_cast<size_t>(ndim) * static_cast<size_t>(ngroups)); // cast to avoid overflow.
+    auto actual = init.run(mat, ngroups, group_centers.data());
+    refine.run(mat, actual, group_centers.data(), groups.data());
+    return groups;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @brief Implements the Yinyang accelerated Lloyd algorithm for k-means clustering.
+ *
+ * The Yinyang algorithm produces the same batch assignments and center calculations as `RefineLloyd` (up to the breaking of ties between equidistant centers).
+ * The centers are first grouped by running k-means on the initial centers.
+ * For each observation, we store an upper bound on the distance to its assigned center and one lower bound per group on the distance to all other centers in that group.
+ * In each iteration, the bounds are adjusted by the movement of the centers (or the maximum movement within each group),
+ * and a global filter skips the observation if the upper bound is no greater than the smallest group bound.
+ * Otherwise, a group filter only considers the groups whose lower bound is less than the upper bound,
+ * and a local filter skips centers within those groups that cannot be closer than the current best.
+ *
+ * This approach is designed for large numbers of centers, where the per-center bounds of `RefineElkan` require too much memory
+ * and the single bound of `RefineHamerly` is not effective at pruning distance calculations.
+ *
+ * In the `Details::status` returned by `run()`, the status code is either 0 (success) or 2 (maximum iterations reached without convergence).
+ *
+ * @tparam Matrix_ Matrix type for the input data.
+ * This should satisfy the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centroids.
+ *
+ * @see
+ * Ding, Y., Zhao, Y., Shen, X., Musuvathi, M. and Mytkowicz, T. (2015).
+ * Yinyang K-means: a drop-in replacement of the classic K-means with consistent speedup.
+ * _Proceedings of the 32nd International Conference on Machine Learning_, 579-587.
+ */
+template<typename Matrix_ = SimpleMatrix<double, int>, typename Cluster_ = int, typename Float_ = double>
+class RefineYinyang : public Refine<Matrix_, Cluster_, Float_> {
+private:
+    RefineYinyangOptions my_options;
+
+    typedef typename Matrix_::index_type Index_;
+
+public:
+    /**
+     * @param options Further options to the Yinyang algorithm.
+     */
+    RefineYinyang(RefineYinyangOptions options) : my_options(std::move(options)) {}
+
+    /**
+     * Default constructor.
+     */
+    RefineYinyang() = default;
+
+public:
+    /**
+     * @return Options for Yinyang clustering,
+     * to be modified prior to calling `run()`.
+     */
+    RefineYinyangOptions& get_options() {
+        return my_options;
+    }
+
+public:
+    Details<Index_> run(const Matrix_& data, Cluster_ ncenters, Float_* centers, Cluster_* clusters) const {
+        auto nobs = data.num_observations();
+        if (internal::is_edge_case(nobs, ncenters)) {
+            return internal::process_edge_case(data, ncenters, centers, clusters);
+        }
+
+        auto ndim = data.num_dimensions();
+        size_t long_ndim = ndim;
+
+        Cluster_ ngroups = my_options.num_groups;
+        if (ngroups <= 0) {
+            ngroups = std::max(static_cast<Cluster_>(1), static_cast<Cluster_>(ncenters / 10));
+        } else if (ngroups > ncenters) {
+            ngroups = ncenters;
+        }
+        size_t long_ngroups = ngroups;
+
+        auto group_of = RefineYinyang_internal::group_centers(ndim, ncenters, static_cast<const Float_*>(centers), ngroups, my_options);
+        std::vector<Cluster_> group_start(ngroups + 1), group_members(ncenters);
+        for (auto g : group_of) {
+            ++group_start[g + 1];
+        }
+        for (Cluster_ g = 0; g < ngroups; ++g) {
+            group_start[g + 1] += group_start[g];
+        }
+        {
+            auto fill = group_start;
+            for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                group_members[fill[group_of[cen]]++] = cen;
+            }
+        }
+
+        std::vector<Float_> upper(nobs);
+        std::vector<Float_> lower(long_ngroups * static_cast<size_t>(nobs)); // cast to avoid overflow.
+        std::vector<Float_> drift(ncenters), group_drift(ngroups);
+        std::vector<Float_> previous(long_ndim * static_cast<size_t>(ncenters)); // cast to avoid overflow.
+
+        int iter = 0, status = 0;
+        std::vector<Index_> sizes(ncenters);
+        std::vector<Cluster_> copy(nobs);
+
+        for (iter = 1; iter <= my_options.max_iterations; ++iter) {
+            if (iter == 1) {
+                // No bounds are available yet, so we compute all distances to initialize them.
+                parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(start, length);
+                    std::vector<Float_> all_dist(ncenters);
+
+                    for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                        auto dptr = data.get_observation(work);
+                        Cluster_ best = 0;
+                        Float_ best_dist = std::numeric_limits<Float_>::max();
+                        for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                            auto dist = internal::distance(centers + static_cast<size_t>(cen) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                            all_dist[cen] = dist;
+                            if (dist < best_dist) {
+                                best = cen;
+                                best_dist = dist;
+                            }
+                        }
+                        copy[obs] = best;
+                        upper[obs] = best_dist;
+
+                        auto obs_lower = lower.data() + static_cast<size_t>(obs) * long_ngroups; // cast to avoid overflow.
+                        std::fill_n(obs_lower, ngroups, std::numeric_limits<Float_>::max());
+                        for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                            if (cen != best) {
+                                auto& current = obs_lower[group_of[cen]];
+                                current = std::min(current, all_dist[cen]);
+                            }
+                        }
+                    }
+                });
+
+            } else {
+                std::fill(group_drift.begin(), group_drift.end(), 0);
+                for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+                    auto& current = group_drift[group_of[cen]];
+                    current = std::max(current, drift[cen]);
+                }
+
+                parallelize(my_options.num_threads, nobs, [&](int, Index_ start, Index_ length) {
+                    auto work = data.create_workspace(start, length);
+                    std::vector<Float_> old_lower(ngroups);
+
+                    for (Index_ obs = start, end = start + length; obs < end; ++obs) {
+                        auto dptr = data.get_observation(work);
+                        auto obs_lower = lower.data() + static_cast<size_t>(obs) * long_ngroups; // cast to avoid overflow.
+
+                        // Shifting the bounds by the movement of the centers in the previous iteration.
+                        Float_ global_lower = std::numeric_limits<Float_>::max();
+                        for (Cluster_ g = 0; g < ngroups; ++g) {
+                            old_lower[g] = obs_lower[g];
+                            obs_lower[g] -= group_drift[g];
+                            global_lower = std::min(global_lower, obs_lower[g]);
+                        }
+
+                        auto old_best = copy[obs];
+                        auto& old_best_dist = upper[obs];
+                        old_best_dist += drift[old_best];
+                        if (old_best_dist <= global_lower) {
+                            continue;
+                        }
+
+                        // Tightening the upper bound, which is often enough to pass the global filter.
+                        old_best_dist = internal::distance(centers + static_cast<size_t>(old_best) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                        if (old_best_dist <= global_lower) {
+                            continue;
+                        }
+
+                        auto best = old_best;
+                        auto best_dist = old_best_dist;
+                        for (Cluster_ g = 0; g < ngroups; ++g) {
+                            if (obs_lower[g] >= best_dist) { // group filter.
+                                continue;
+                            }
+
+                            // Each group's bound excludes the current best center, so if the
+                            // best center changes, the previous one needs to be folded back into
+                            // the bound of its own group. The exception is the originally
+                            // assigned center, which is handled after all groups are processed.
+                            Float_ group_lower = std::numeric_limits<Float_>::max();
+                            auto demote = [&](Cluster_ cen, Float_ dist) -> void {
+                                if (cen == old_best) {
+                                    return;
+                                }
+                                auto cen_group = group_of[cen];
+                                if (cen_group == g) {
+                                    group_lower = std::min(group_lower, dist);
+                                } else {
+                                    obs_lower[cen_group] = std::min(obs_lower[cen_group], dist);
+                                }
+                            };
+
+                            for (Cluster_ i = group_start[g], end = group_start[g + 1]; i < end; ++i) {
+                                auto cen = group_members[i];
+                                if (cen == old_best) {
+                                    continue;
+                                }
+
+                                // Local filter, using the bound before it was shifted by the maximum drift in the group.
+                                auto cen_lower = old_lower[g] - drift[cen];
+                                if (cen_lower >= best_dist) {
+                                    group_lower = std::min(group_lower, cen_lower);
+                                    continue;
+                                }
+
+                                auto dist = internal::distance(centers + static_cast<size_t>(cen) * long_ndim, dptr, ndim); // cast to avoid overflow.
+                                if (dist < best_dist) {
+                                    demote(best, best_dist);
+                                    best = cen;
+                                    best_dist = dist;
+                                } else {
+                                    group_lower = std::min(group_lower, dist);
+                                }
+                            }
+
+                            obs_lower[g] = group_lower;
+                        }
+
+                        if (best != old_best) {
+                            auto& current = obs_lower[group_of[old_best]];
+                            current = std::min(current, old_best_dist);
+                            copy[obs] = best;
+                            old_best_dist = best_dist;
+                        }
+                    }
+                });
+            }
+
+            // Checking if it already converged.
+            bool updated = false;
+            for (Index_ obs = 0; obs < nobs; ++obs) {
+                if (copy[obs] != clusters[obs]) {
+                    updated = true;
+                    break;
+                }
+            }
+            if (!updated) {
+                break;
+            }
+            std::copy(copy.begin(), copy.end(), clusters);
+
+            std::fill(sizes.begin(), sizes.end(), 0);
+            for (Index_ obs = 0; obs < nobs; ++obs) {
+                ++sizes[clusters[obs]];
+            }
+
+            std::copy_n(centers, previous.size(), previous.begin());
+            internal::compute_centroids(data, ncenters, centers, clusters, sizes, my_options.num_threads);
+            internal::compute_center_drift(ndim, ncenters, previous.data(), centers, drift.data());
+        }
+
+        if (iter == my_options.max_iterations + 1) {
+            status = 2;
+        }
+
+        return Details<Index_>(std::move(sizes), iter, status);
+    }
+};
+
+}
+
+#endif
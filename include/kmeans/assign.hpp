@@ -0,0 +1,101 @@
+#ifndef KMEANS_ASSIGN_HPP
+#define KMEANS_ASSIGN_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "CenterSearch.hpp"
+#include "AssignmentStrategy.hpp"
+#include "parallelize.hpp"
+
+/**
+ * @file assign.hpp
+ * @brief Assign observations to their closest centers.
+ */
+
+namespace kmeans {
+
+/**
+ * @brief Options for `assign()`.
+ */
+struct AssignOptions {
+    /**
+     * Strategy for finding the closest center to each observation.
+     */
+    AssignmentStrategy assignment_strategy = AssignmentStrategy::AUTOMATIC;
+
+    /**
+     * Number of threads to use.
+     * The parallelization scheme is defined by `parallelize()`.
+     */
+    int num_threads = 1;
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+template<class Matrix_, typename Float_, typename Cluster_, typename Dim_>
+void assign_all(const Matrix_& data, const CenterSearch<Float_, Cluster_, Dim_>& index, Cluster_* clusters, int nthreads) {
+    typedef typename Matrix_::index_type Index_;
+    parallelize(nthreads, data.num_observations(), [&](int, Index_ start, Index_ length) {
+        auto work = data.create_workspace(start, length);
+        auto swork = index.create_workspace();
+        index.find(
+            swork,
+            length,
+            [&]() -> auto { return data.get_observation(work); },
+            [&](Index_ i, Cluster_ best) -> void { clusters[start + i] = best; }
+        );
+    });
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Assign each observation to its closest center.
+ * This is typically used to assign observations to centers that were computed on a subset of the data,
+ * e.g., by `RefineMiniBatch` with `RefineMiniBatchOptions::final_pass = MiniBatchFinalPass::NONE`.
+ * Each thread reads a contiguous range of observations with a `MockMatrix::ConsecutiveAccessWorkspace`.
+ *
+ * @tparam Matrix_ Matrix type for the input data, satisfying the `MockMatrix` contract.
+ * @tparam Cluster_ Integer type for the cluster assignments.
+ * @tparam Float_ Floating-point type for the centers.
+ *
+ * @param data A matrix-like object (see `MockMatrix`) containing per-observation data.
+ * @param ncenters Number of cluster centers.
+ * If zero, `clusters` is not modified.
+ * @param[in] centers Pointer to an array of length equal to the product of `ncenters` and `data.num_dimensions()`.
+ * This contains a column-major matrix where rows correspond to dimensions and columns correspond to cluster centers.
+ * @param[out] clusters Pointer to an array of length equal to the number of observations (from `data.num_observations()`).
+ * On output, this will contain the 0-based index of the closest center for each observation.
+ * @param options Further options.
+ *
+ * @return Vector of length `ncenters`, containing the number of observations assigned to each center.
+ */
+template<class Matrix_, typename Cluster_, typename Float_>
+std::vector<typename Matrix_::index_type> assign(const Matrix_& data, Cluster_ ncenters, const Float_* centers, Cluster_* clusters, const AssignOptions& options) {
+    std::vector<typename Matrix_::index_type> sizes(ncenters);
+    if (ncenters == 0) {
+        return sizes;
+    }
+
+    auto nobs = data.num_observations();
+    auto ndim = data.num_dimensions();
+    internal::CenterSearch<Float_, Cluster_, decltype(ndim)> index(options.assignment_strategy, nobs, ncenters, ndim, options.num_threads);
+    index.reset(ndim, ncenters, centers);
+    internal::assign_all(data, index, clusters, options.num_threads);
+
+    for (decltype(nobs) o = 0; o < nobs; ++o) {
+        ++sizes[clusters[o]];
+    }
+    return sizes;
+}
+
+}
+
+#endif
@@ -2,6 +2,9 @@
 #define KMEANS_COMPUTE_CENTROIDS_HPP
 
 #include <algorithm>
+#include <vector>
+
+#include "parallelize.hpp"
 
 namespace kmeans {
 
@@ -27,33 +30,121 @@ void compute_centroid(const Matrix_& data, Float_* center) {
 }
 
 template<class Matrix_, typename Cluster_, typename Float_>
-void compute_centroids(const Matrix_& data, Cluster_ ncenters, Float_* centers, const Cluster_* clusters, const std::vector<typename Matrix_::index_type>& sizes) {
+void compute_centroid_sums(const Matrix_& data, Cluster_ ncenters, Float_* sums, const Cluster_* clusters, int nthreads) {
     auto nobs = data.num_observations();
     auto ndim = data.num_dimensions();
     size_t long_ndim = ndim;
-    std::fill(centers, centers + long_ndim * static_cast<size_t>(ncenters), 0); // cast to avoid overflow.
+    std::fill(sums, sums + long_ndim * static_cast<size_t>(ncenters), 0); // cast to avoid overflow.
 
-    auto work = data.create_workspace(static_cast<typename Matrix_::index_type>(0), nobs);
-    for (decltype(nobs) obs = 0; obs < nobs; ++obs) {
-        auto copy = centers + static_cast<size_t>(clusters[obs]) * long_ndim;
-        auto mine = data.get_observation(work);
-        for (decltype(ndim) dim = 0; dim < ndim; ++dim, ++copy, ++mine) {
-            *copy += static_cast<Float_>(*mine); // cast for consistent precision regardless of Matrix_::data_type.
+    typedef typename Matrix_::index_type Index_;
+    if (nthreads <= 1) {
+        auto work = data.create_workspace(static_cast<Index_>(0), nobs);
+        for (Index_ obs = 0; obs < nobs; ++obs) {
+            auto copy = sums + static_cast<size_t>(clusters[obs]) * long_ndim;
+            auto mine = data.get_observation(work);
+            for (decltype(ndim) dim = 0; dim < ndim; ++dim, ++copy, ++mine) {
+                *copy += static_cast<Float_>(*mine); // cast for consistent precision regardless of Matrix_::data_type.
+            }
+        }
+        return;
+    }
+
+    // Each thread takes ownership of a contiguous range of clusters, so the
+    // observations for each cluster are still added in their original order.
+    // This ensures that we get exactly the same results as the serial case,
+    // regardless of the number of threads.
+    parallelize(nthreads, ncenters, [&](int, Cluster_ start, Cluster_ length) {
+        Cluster_ end = start + length;
+        std::vector<Index_> mine;
+        for (Index_ obs = 0; obs < nobs; ++obs) {
+            auto c = clusters[obs];
+            if (c >= start && c < end) {
+                mine.push_back(obs);
+            }
+        }
+
+        auto work = data.create_workspace(mine.data(), static_cast<Index_>(mine.size()));
+        for (auto obs : mine) {
+            auto copy = sums + static_cast<size_t>(clusters[obs]) * long_ndim;
+            auto optr = data.get_observation(work);
+            for (decltype(ndim) dim = 0; dim < ndim; ++dim, ++copy, ++optr) {
+                *copy += static_cast<Float_>(*optr); // cast for consistent precision regardless of Matrix_::data_type.
+            }
+        }
+    });
+}
+
+/*
+ * Moves the observations in 'changed' from their 'previous' clusters to their
+ * 'current' clusters, by subtracting and adding their coordinates to the sums.
+ * 'changed' should be sorted and unique.
+ */
+template<class Matrix_, typename Cluster_, typename Float_>
+void update_centroid_sums(
+    const Matrix_& data,
+    Float_* sums,
+    const std::vector<typename Matrix_::index_type>& changed,
+    const Cluster_* previous,
+    const Cluster_* current)
+{
+    auto ndim = data.num_dimensions();
+    size_t long_ndim = ndim;
+    auto work = data.create_workspace(changed.data(), static_cast<typename Matrix_::index_type>(changed.size()));
 
+    for (auto obs : changed) {
+        auto mine = data.get_observation(work);
+        auto from = sums + static_cast<size_t>(previous[obs]) * long_ndim; // cast to avoid overflow.
+        auto to = sums + static_cast<size_t>(current[obs]) * long_ndim;
+        for (decltype(ndim) dim = 0; dim < ndim; ++dim, ++mine, ++from, ++to) {
+            Float_ val = *mine; // cast for consistent precision regardless of Matrix_::data_type.
+            *from -= val;
+            *to += val;
         }
     }
+}
 
+template<typename Dim_, typename Cluster_, typename Float_, typename Index_>
+void normalize_centroids(Dim_ ndim, Cluster_ ncenters, Float_* centers, const std::vector<Index_>& sizes) {
+    size_t long_ndim = ndim;
     for (Cluster_ cen = 0; cen < ncenters; ++cen) {
         auto s = sizes[cen];
         if (s) {
             auto curcenter = centers + static_cast<size_t>(cen) * long_ndim; // cast to avoid overflow.
-            for (int dim = 0; dim < ndim; ++dim, ++curcenter) {
+            for (Dim_ dim = 0; dim < ndim; ++dim, ++curcenter) {
                 *curcenter /= s;
             }
         }
     }
 }
 
+template<class Matrix_, typename Cluster_, typename Float_>
+void compute_centroids(const Matrix_& data, Cluster_ ncenters, Float_* centers, const Cluster_* clusters, const std::vector<typename Matrix_::index_type>& sizes, int nthreads) {
+    compute_centroid_sums(data, ncenters, centers, clusters, nthreads);
+    normalize_centroids(data.num_dimensions(), ncenters, centers, sizes);
+}
+
+/*
+ * Computes the centroids from pre-computed sums. Empty clusters have their
+ * centroids set to zero, for consistency with compute_centroids().
+ */
+template<typename Dim_, typename Cluster_, typename Float_, typename Index_>
+void compute_centroids_from_sums(Dim_ ndim, Cluster_ ncenters, const Float_* sums, Float_* centers, const std::vector<Index_>& sizes) {
+    size_t long_ndim = ndim;
+    for (Cluster_ cen = 0; cen < ncenters; ++cen) {
+        auto offset = static_cast<size_t>(cen) * long_ndim; // cast to avoid overflow.
+        auto cursum = sums + offset;
+        auto curcenter = centers + offset;
+        auto s = sizes[cen];
+        if (s) {
+            for (Dim_ dim = 0; dim < ndim; ++dim) {
+                curcenter[dim] = cursum[dim] / s;
+            }
+        } else {
+            std::fill_n(curcenter, ndim, 0);
+        }
+    }
+}
+
 }
 
 }
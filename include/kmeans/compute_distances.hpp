@@ -0,0 +1,117 @@
+#ifndef KMEANS_COMPUTE_DISTANCES_HPP
+#define KMEANS_COMPUTE_DISTANCES_HPP
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "parallelize.hpp"
+
+namespace kmeans {
+
+namespace internal {
+
+template<typename Float_, typename Data_, typename Dim_>
+Float_ raw_distance(const Float_* center, const Data_* obs, Dim_ ndim) {
+    Float_ output = 0;
+    for (Dim_ d = 0; d < ndim; ++d, ++center, ++obs) {
+        Float_ delta = *center - static_cast<Float_>(*obs); // cast to ensure consistent precision regardless of Data_.
+        output += delta * delta;
+    }
+    return output;
+}
+
+template<typename Float_, typename Data_, typename Dim_>
+Float_ distance(const Float_* center, const Data_* obs, Dim_ ndim) {
+    return std::sqrt(raw_distance(center, obs, ndim));
+}
+
+/*
+ * Fills 'distances' with a symmetric ncenters * ncenters matrix of
+ * center-to-center distances, for use in triangle inequality checks.
+ */
+template<typename Dim_, typename Cluster_, typename Float_>
+void compute_center_distances(Dim_ ndim, Cluster_ ncenters, const Float_* centers, std::vector<Float_>& distances, int nthreads) {
+    size_t long_ndim = ndim;
+    size_t long_ncenters = ncenters;
+    distances.resize(long_ncenters * long_ncenters);
+
+    parallelize(nthreads, ncenters, [&](int, Cluster_ start, Cluster_ length) {
+        for (Cluster_ c1 = start, end = start + length; c1 < end; ++c1) {
+            auto c1_ptr = centers + static_cast<size_t>(c1) * long_ndim; // cast to avoid overflow.
+            auto c1_dist = distances.data() + static_cast<size_t>(c1) * long_ncenters;
+            for (Cluster_ c2 = 0; c2 < ncenters; ++c2) {
+                if (c1 == c2) {
+                    c1_dist[c2] = 0;
+                } else {
+                    c1_dist[c2] = distance(c1_ptr, centers + static_cast<size_t>(c2) * long_ndim, ndim);
+                }
+            }
+        }
+    });
+}
+
+/*
+ * Same as above, but also fills 'closest' with the distance from each center
+ * to its nearest neighboring center. Both are used by the triangle inequality
+ * checks in the bound-based refinement algorithms.
+ */
+template<typename Dim_, typename Cluster_, typename Float_>
+void compute_center_distances(Dim_ ndim, Cluster_ ncenters, const Float_* centers, std::vector<Float_>& distances, std::vector<Float_>& closest, int nthreads) {
+    compute_center_distances(ndim, ncenters, centers, distances, nthreads);
+
+    size_t long_ncenters = ncenters;
+    closest.resize(ncenters);
+    for (Cluster_ c1 = 0; c1 < ncenters; ++c1) {
+        auto c1_dist = distances.data() + static_cast<size_t>(c1) * long_ncenters;
+        auto& current = closest[c1];
+        current = std::numeric_limits<Float_>::max();
+        for (Cluster_ c2 = 0; c2 < ncenters; ++c2) {
+            if (c1 != c2 && c1_dist[c2] < current) {
+                current = c1_dist[c2];
+            }
+        }
+    }
+}
+
+/*
+ * Only computes the distance from each center to its nearest neighboring
+ * center, without storing the full matrix of center-to-center distances.
+ */
+template<typename Dim_, typename Cluster_, typename Float_>
+void compute_closest_center_distances(Dim_ ndim, Cluster_ ncenters, const Float_* centers, std::vector<Float_>& closest, int nthreads) {
+    size_t long_ndim = ndim;
+    closest.resize(ncenters);
+
+    parallelize(nthreads, ncenters, [&](int, Cluster_ start, Cluster_ length) {
+        for (Cluster_ c1 = start, end = start + length; c1 < end; ++c1) {
+            auto c1_ptr = centers + static_cast<size_t>(c1) * long_ndim; // cast to avoid overflow.
+            auto& current = closest[c1];
+            current = std::numeric_limits<Float_>::max();
+            for (Cluster_ c2 = 0; c2 < ncenters; ++c2) {
+                if (c1 != c2) {
+                    auto dist = distance(c1_ptr, centers + static_cast<size_t>(c2) * long_ndim, ndim);
+                    if (dist < current) {
+                        current = dist;
+                    }
+                }
+            }
+        }
+    });
+}
+
+template<typename Dim_, typename Cluster_, typename Float_>
+void compute_center_drift(Dim_ ndim, Cluster_ ncenters, const Float_* previous, const Float_* current, Float_* drift) {
+    size_t long_ndim = ndim;
+    for (Cluster_ c = 0; c < ncenters; ++c) {
+        auto offset = static_cast<size_t>(c) * long_ndim; // cast to avoid overflow.
+        drift[c] = distance(previous + offset, current + offset, ndim);
+    }
+}
+
+}
+
+}
+
+#endif
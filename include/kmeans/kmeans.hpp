@@ -5,17 +5,25 @@
 #include "Refine.hpp"
 #include "Initialize.hpp"
 #include "MockMatrix.hpp"
+#include "AssignmentStrategy.hpp"
 
 #include "InitializeKmeanspp.hpp"
+#include "InitializeKmeansParallel.hpp"
 #include "InitializeRandom.hpp"
 #include "InitializeVariancePartition.hpp"
 #include "InitializeNone.hpp"
 
 #include "RefineHartiganWong.hpp"
 #include "RefineLloyd.hpp"
+#include "RefineElkan.hpp"
+#include "RefineHamerly.hpp"
+#include "RefineYinyang.hpp"
+#include "RefineFiltering.hpp"
 #include "RefineMiniBatch.hpp"
+#include "RefineNestedMiniBatch.hpp"
 
 #include "compute_wcss.hpp"
+#include "assign.hpp"
 
 /** 
  * @file kmeans.hpp
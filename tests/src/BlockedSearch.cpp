@@ -0,0 +1,101 @@
+#include "TestCore.h"
+
+#include "kmeans/BlockedSearch.hpp"
+
+class BlockedSearchTest : public TestCore, public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        assemble(GetParam());
+    }
+
+    static std::vector<std::pair<double, int> > sort_by_distance(const double* self, int ncenters) {
+        std::vector<std::pair<double, int> > output;
+        for (int b = 0; b < ncenters; ++b) {
+            double d2 = 0;
+            auto other = data.data() + b * nr;
+            for (int r = 0; r < nr; ++r) {
+                double delta = other[r] - self[r];
+                d2 += delta * delta;
+            }
+            output.emplace_back(d2, b);
+        }
+        std::sort(output.begin(), output.end());
+        return output;
+    }
+};
+
+TEST_P(BlockedSearchTest, Sweep) {
+    // Using the first half as centers, so that we get non-identical queries.
+    auto half_nc = nc/2;
+    kmeans::internal::BlockedSearch<double, int, int> index(nr, half_nc, data.data());
+    auto work = index.create_workspace();
+
+    int counter = 0;
+    std::vector<int> best(nc, -1);
+    index.find(
+        work,
+        nc,
+        [&]() -> const double* { return data.data() + (counter++) * nr; },
+        [&](int i, int b) -> void { best[i] = b; }
+    );
+    EXPECT_EQ(counter, nc);
+
+    for (int c = 0; c < nc; ++c) {
+        auto self = data.data() + c * nr;
+        if (c < half_nc) {
+            EXPECT_EQ(c, best[c]);
+        } else {
+            auto expected = sort_by_distance(self, half_nc);
+            EXPECT_EQ(expected.front().second, best[c]);
+        }
+    }
+}
+
+TEST_P(BlockedSearchTest, TakeTwo) {
+    kmeans::internal::BlockedSearch<double, int, int> index(nr, nc, data.data());
+    auto work = index.create_workspace();
+
+    int counter = 0;
+    std::vector<int> best(nc, -1), second(nc, -1);
+    index.find2(
+        work,
+        nc,
+        [&]() -> const double* { return data.data() + (counter++) * nr; },
+        [&](int i, int b, int s) -> void { 
+            best[i] = b;
+            second[i] = s;
+        }
+    );
+
+    for (int c = 0; c < nc; ++c) {
+        auto expected = sort_by_distance(data.data() + c * nr, nc);
+        EXPECT_EQ(c, best[c]);
+        EXPECT_EQ(expected[1].second, second[c]);
+    }
+}
+
+TEST_P(BlockedSearchTest, Reuse) {
+    // Checking that the workspace can be re-used across multiple calls with different numbers of queries.
+    kmeans::internal::BlockedSearch<double, int, int> index(nr, nc, data.data());
+    auto work = index.create_workspace();
+
+    for (int start = 0; start < nc; start += 7) {
+        int num = std::min(nc - start, 7);
+        int counter = start;
+        index.find(
+            work,
+            num,
+            [&]() -> const double* { return data.data() + (counter++) * nr; },
+            [&](int i, int b) -> void { EXPECT_EQ(b, start + i); }
+        );
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    BlockedSearch,
+    BlockedSearchTest,
+    ::testing::Combine(
+        ::testing::Values(10, 20, 150), // number of dimensions
+        ::testing::Values(2, 10, 50, 301, 600) // number of observations 
+    )
+);
@@ -0,0 +1,161 @@
+#include "TestCore.h"
+
+#include "kmeans/CenterSearch.hpp"
+
+class CenterSearchTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, kmeans::AssignmentStrategy> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+
+    static std::vector<std::pair<double, int> > sort_by_distance(const double* self, int ncenters) {
+        std::vector<std::pair<double, int> > output;
+        for (int b = 0; b < ncenters; ++b) {
+            double d2 = 0;
+            auto other = data.data() + b * nr;
+            for (int r = 0; r < nr; ++r) {
+                double delta = other[r] - self[r];
+                d2 += delta * delta;
+            }
+            output.emplace_back(d2, b);
+        }
+        std::sort(output.begin(), output.end());
+        return output;
+    }
+};
+
+TEST_P(CenterSearchTest, Sweep) {
+    auto strategy = std::get<1>(GetParam());
+
+    // Using the first half as centers, so that we get non-identical queries.
+    auto half_nc = nc/2;
+    kmeans::internal::CenterSearch<double, int, int> index(strategy, nc, half_nc, nr, 1);
+    EXPECT_NE(index.get_strategy(), kmeans::AssignmentStrategy::AUTOMATIC);
+    if (strategy != kmeans::AssignmentStrategy::AUTOMATIC) {
+        EXPECT_EQ(index.get_strategy(), strategy);
+    }
+
+    index.reset(nr, half_nc, data.data());
+    auto work = index.create_workspace();
+    int counter = 0;
+    std::vector<int> best(nc, -1);
+    index.find(
+        work,
+        nc,
+        [&]() -> const double* { return data.data() + (counter++) * nr; },
+        [&](int i, int b) -> void { best[i] = b; }
+    );
+
+    for (int c = 0; c < nc; ++c) {
+        if (c < half_nc) {
+            EXPECT_EQ(c, best[c]);
+        } else {
+            auto expected = sort_by_distance(data.data() + c * nr, half_nc);
+            EXPECT_EQ(expected.front().second, best[c]);
+        }
+    }
+}
+
+TEST_P(CenterSearchTest, TakeTwo) {
+    auto strategy = std::get<1>(GetParam());
+    kmeans::internal::CenterSearch<double, int, int> index(strategy, nc, nc, nr, 1);
+    index.reset(nr, nc, data.data());
+
+    auto work = index.create_workspace();
+    int counter = 0;
+    std::vector<int> best(nc, -1), second(nc, -1);
+    index.find2(
+        work,
+        nc,
+        [&]() -> const double* { return data.data() + (counter++) * nr; },
+        [&](int i, int b, int s) -> void { 
+            best[i] = b;
+            second[i] = s;
+        }
+    );
+
+    for (int c = 0; c < nc; ++c) {
+        auto expected = sort_by_distance(data.data() + c * nr, nc);
+        EXPECT_EQ(c, best[c]);
+        EXPECT_EQ(expected[1].second, second[c]);
+    }
+}
+
+TEST_P(CenterSearchTest, Update) {
+    auto strategy = std::get<1>(GetParam());
+    auto half_nc = nc/2;
+    kmeans::internal::CenterSearch<double, int, int> index(strategy, nc, half_nc, nr, 1);
+    std::vector<double> centers(data.begin(), data.begin() + half_nc * nr);
+
+    // First update() is the same as a reset(), and subsequent calls should handle centers that move by varying amounts.
+    std::mt19937_64 rng(nr * nc);
+    std::normal_distribution<double> norm;
+    for (double scale : { 0.0, 0.0, 1e-4, 1e-3, 1.0 }) {
+        for (auto& c : centers) {
+            c += norm(rng) * scale;
+        }
+        index.update(nr, half_nc, centers.data());
+
+        auto work = index.create_workspace();
+        int counter = 0;
+        std::vector<int> best(nc, -1);
+        index.find(
+            work,
+            nc,
+            [&]() -> const double* { return data.data() + (counter++) * nr; },
+            [&](int i, int b) -> void { best[i] = b; }
+        );
+
+        for (int c = 0; c < nc; ++c) {
+            auto self = data.data() + c * nr;
+            double best_dist = std::numeric_limits<double>::infinity();
+            int expected = -1;
+            for (int b = 0; b < half_nc; ++b) {
+                double d2 = 0;
+                for (int r = 0; r < nr; ++r) {
+                    double delta = centers[b * nr + r] - self[r];
+                    d2 += delta * delta;
+                }
+                if (d2 < best_dist) {
+                    best_dist = d2;
+                    expected = b;
+                }
+            }
+            EXPECT_EQ(expected, best[c]);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    CenterSearch,
+    CenterSearchTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(2, 10, 20), // number of dimensions
+            ::testing::Values(2, 10, 50, 301) // number of observations 
+        ),
+        ::testing::Values(
+            kmeans::AssignmentStrategy::AUTOMATIC,
+            kmeans::AssignmentStrategy::VANTAGE_POINT_TREE,
+            kmeans::AssignmentStrategy::BRUTE_FORCE,
+            kmeans::AssignmentStrategy::BLOCKED_DOT_PRODUCT
+        )
+    )
+);
+
+TEST(CenterSearch, CostModel) {
+    // Few centers always favor brute force.
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10000, 1, 2), kmeans::AssignmentStrategy::BRUTE_FORCE);
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10000, 5, 2), kmeans::AssignmentStrategy::BRUTE_FORCE);
+
+    // Many centers in low dimensions favor the tree.
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10000, 1000, 2), kmeans::AssignmentStrategy::VANTAGE_POINT_TREE);
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10000, 10000, 4), kmeans::AssignmentStrategy::VANTAGE_POINT_TREE);
+
+    // Unless there are too few observations to amortize the cost of building the tree.
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10, 1000, 2), kmeans::AssignmentStrategy::BRUTE_FORCE);
+
+    // High dimensions favor brute force.
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10000, 1000, 50), kmeans::AssignmentStrategy::BRUTE_FORCE);
+    EXPECT_EQ(kmeans::internal::choose_assignment_strategy(10000, 10000, 100), kmeans::AssignmentStrategy::BRUTE_FORCE);
+}
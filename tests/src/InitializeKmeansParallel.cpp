@@ -0,0 +1,287 @@
+#include "TestCore.h"
+
+#include <random>
+#include <vector>
+
+#ifdef CUSTOM_PARALLEL_TEST
+// Must be before any kmeans imports.
+#include "custom_parallel.h"
+#endif
+
+#include "kmeans/InitializeKmeansParallel.hpp"
+
+class KmeansParallelInitializationTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+};
+
+TEST_P(KmeansParallelInitializationTest, Candidates) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    int seed = ncenters * 10 + nr + nc;
+    auto candidates = kmeans::InitializeKmeansParallel_internal::sample_candidates<double>(mat, 2.0 * ncenters, 5, ncenters, seed, 1);
+    EXPECT_GE(candidates.ids.size(), ncenters);
+    EXPECT_EQ(candidates.weights.size(), candidates.ids.size());
+    EXPECT_EQ(candidates.coordinates.size(), candidates.ids.size() * nr);
+
+    // No duplicates and all in range.
+    {
+        auto copy = candidates.ids;
+        std::sort(copy.begin(), copy.end());
+        EXPECT_TRUE(std::adjacent_find(copy.begin(), copy.end()) == copy.end());
+        for (auto o : copy) {
+            EXPECT_TRUE(o >= 0 && o < nc);
+        }
+    }
+
+    // Coordinates are copied correctly.
+    for (size_t c = 0; c < candidates.ids.size(); ++c) {
+        auto ptr = data.data() + candidates.ids[c] * nr;
+        EXPECT_EQ(std::vector<double>(ptr, ptr + nr), std::vector<double>(candidates.coordinates.begin() + c * nr, candidates.coordinates.begin() + (c + 1) * nr));
+    }
+
+    // Weights are the number of observations that are closest to each candidate.
+    {
+        std::vector<int> expected(candidates.ids.size());
+        for (int o = 0; o < nc; ++o) {
+            auto optr = data.data() + o * nr;
+            double best = std::numeric_limits<double>::infinity();
+            int chosen = 0;
+            for (size_t c = 0; c < candidates.ids.size(); ++c) {
+                double r2 = 0;
+                for (int d = 0; d < nr; ++d) {
+                    double delta = optr[d] - candidates.coordinates[c * nr + d];
+                    r2 += delta * delta;
+                }
+                if (r2 < best) {
+                    best = r2;
+                    chosen = c;
+                }
+            }
+            ++expected[chosen];
+        }
+        EXPECT_EQ(expected, candidates.weights);
+    }
+
+    // Check that parallelization gives the same result.
+    {
+        auto pcandidates = kmeans::InitializeKmeansParallel_internal::sample_candidates<double>(mat, 2.0 * ncenters, 5, ncenters, seed, 3);
+        EXPECT_EQ(candidates.ids, pcandidates.ids);
+        EXPECT_EQ(candidates.weights, pcandidates.weights);
+    }
+}
+
+TEST_P(KmeansParallelInitializationTest, Internals) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    kmeans::InitializeKmeansParallelOptions opt;
+    opt.seed = ncenters * 10 + nr + nc;
+    auto output = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, ncenters, opt);
+    EXPECT_EQ(output.size(), ncenters);
+
+    // Check that a reasonable selection is made.
+    {
+        auto copy = output;
+        int last = -1;
+        std::sort(copy.begin(), copy.end());
+        for (auto o : copy) {
+            EXPECT_TRUE(o > last); // no duplicates
+            EXPECT_TRUE(o < nc); // in range
+            last = o;
+        }
+    }
+
+    // Consistent results with the same initialization.
+    {
+        auto output2 = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, ncenters, opt);
+        EXPECT_EQ(output, output2);
+
+        // Different results with a different seed (note that this only works
+        // if num obs is reasonably larger than num centers).
+        auto opt2 = opt;
+        opt2.seed += 1;
+        auto output3 = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, ncenters, opt2);
+        EXPECT_NE(output, output3);
+    }
+
+    // Check that parallelization gives the same result.
+    for (int threads : { 2, 3, 8 }) {
+        auto popt = opt;
+        popt.num_threads = threads;
+        auto output2 = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, ncenters, popt);
+        EXPECT_EQ(output, output2);
+    }
+}
+
+TEST_P(KmeansParallelInitializationTest, Basic) {
+    auto ncenters = std::get<1>(GetParam());
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    kmeans::InitializeKmeansParallel init;
+    std::vector<double> centers(nr * ncenters);
+    auto nfilled = init.run(mat, ncenters, centers.data());
+    EXPECT_EQ(nfilled, ncenters);
+
+    auto matched = match_to_data(ncenters, centers);
+    for (auto m : matched) {
+        EXPECT_TRUE(m >= 0);
+        EXPECT_TRUE(m < nc);
+    }
+
+    std::sort(matched.begin(), matched.end());
+    for (size_t i = 1; i < matched.size(); ++i) {
+        EXPECT_TRUE(matched[i] > matched[i-1]);
+    }
+
+    // Same results with parallelization.
+    {
+        kmeans::InitializeKmeansParallelOptions popt;
+        popt.num_threads = 3;
+        kmeans::InitializeKmeansParallel pinit(popt);
+        std::vector<double> pcenters(nr * ncenters);
+        pinit.run(mat, ncenters, pcenters.data());
+        EXPECT_EQ(pcenters, centers);
+    }
+}
+
+TEST_P(KmeansParallelInitializationTest, Sanity) {
+    auto ncenters = std::get<1>(GetParam());
+    auto dups = create_duplicate_matrix(ncenters);
+
+    // Expect one entry from each of the first 'ncenters' elements;
+    // all others are duplicates and should have sampling probabilities of zero.
+    kmeans::SimpleMatrix mat(nr, nc, dups.data.data());
+    kmeans::InitializeKmeansParallelOptions opt;
+    opt.seed = ncenters * 100;
+    auto output = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, ncenters, opt);
+
+    EXPECT_EQ(output.size(), ncenters);
+    for (auto& o : output) {
+        o = dups.clusters[o];
+    }
+    std::sort(output.begin(), output.end());
+
+    std::vector<int> expected(ncenters);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, output);
+
+    // If more clusters are requested, we detect that only duplicates are available and we bail early.
+    auto output2 = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, ncenters + 1, opt);
+    EXPECT_EQ(output2.size(), ncenters);
+    for (auto& o : output2) {
+        o = dups.clusters[o];
+    }
+    std::sort(output2.begin(), output2.end());
+    EXPECT_EQ(expected, output2);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    KmeansParallelInitialization,
+    KmeansParallelInitializationTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(10, 20), // number of dimensions
+            ::testing::Values(20, 200, 2000) // number of observations
+        ),
+        ::testing::Values(2, 5, 10) // number of clusters
+    )
+);
+
+class KmeansParallelInitializationEdgeTest : public TestCore, public ::testing::Test {
+protected:
+    void SetUp() {
+        assemble({ 10, 20 });
+    }
+};
+
+TEST_F(KmeansParallelInitializationEdgeTest, TooManyClusters) {
+    kmeans::InitializeKmeansParallel init;
+
+    std::vector<double> centers(nc * nr);
+    auto nfilled = init.run(kmeans::SimpleMatrix(nr, nc, data.data()), nc, centers.data());
+    EXPECT_EQ(nfilled, nc);
+
+    // Check that there's one representative from each cluster.
+    auto matched = match_to_data(nc, centers);
+    std::sort(matched.begin(), matched.end());
+    std::vector<int> expected(nc);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(matched, expected);
+
+    // Same as if we have more clusters.
+    std::vector<double> centers2(nc * nr);
+    auto nfilled2 = init.run(kmeans::SimpleMatrix(nr, nc, data.data()), nc + 10, centers2.data());
+    EXPECT_EQ(nfilled2, nc);
+    auto matched2 = match_to_data(nc, centers2);
+    std::sort(matched2.begin(), matched2.end());
+    EXPECT_EQ(matched2, expected);
+}
+
+TEST_F(KmeansParallelInitializationEdgeTest, FewRounds) {
+    // Extra rounds are performed if there aren't enough candidates.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto candidates = kmeans::InitializeKmeansParallel_internal::sample_candidates<double>(mat, 0.1, 1, 15, 42, 1);
+    EXPECT_GE(candidates.ids.size(), 15);
+}
+
+TEST_F(KmeansParallelInitializationEdgeTest, Rounds) {
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    // No sampling rounds, so we only have the initial candidate.
+    auto candidates0 = kmeans::InitializeKmeansParallel_internal::sample_candidates<double>(mat, 5, 0, 1, 42, 1);
+    EXPECT_EQ(candidates0.ids.size(), 1);
+    EXPECT_EQ(candidates0.weights[0], nc);
+
+    // One round samples further candidates beyond the initial one.
+    auto candidates1 = kmeans::InitializeKmeansParallel_internal::sample_candidates<double>(mat, 5, 1, 1, 42, 1);
+    EXPECT_GT(candidates1.ids.size(), 1);
+    EXPECT_EQ(candidates1.ids.front(), candidates0.ids.front());
+
+    // Each additional round samples at least as many candidates.
+    size_t last = candidates1.ids.size();
+    for (int r = 2; r <= 4; ++r) {
+        auto candidates = kmeans::InitializeKmeansParallel_internal::sample_candidates<double>(mat, 5, r, 1, 42, 1);
+        EXPECT_GE(candidates.ids.size(), last);
+        last = candidates.ids.size();
+    }
+}
+
+TEST_F(KmeansParallelInitializationEdgeTest, NonPositiveOversampling) {
+    // Additional rounds still sample enough candidates, so we get all requested centers.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    for (double factor : { 0.0, -1.0 }) {
+        kmeans::InitializeKmeansParallelOptions opt;
+        opt.oversampling_factor = factor;
+        auto output = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, 5, opt);
+        EXPECT_EQ(output.size(), 5);
+        std::sort(output.begin(), output.end());
+        EXPECT_TRUE(std::adjacent_find(output.begin(), output.end()) == output.end());
+
+        // Same for all observations.
+        auto output2 = kmeans::InitializeKmeansParallel_internal::run_kmeans_parallel<double>(mat, nc, opt);
+        EXPECT_EQ(output2.size(), nc);
+    }
+}
+
+TEST_F(KmeansParallelInitializationEdgeTest, Empty) {
+    kmeans::InitializeKmeansParallel init;
+    std::vector<double> centers(nr);
+    EXPECT_EQ(init.run(kmeans::SimpleMatrix(nr, nc, data.data()), 0, centers.data()), 0);
+    EXPECT_EQ(init.run(kmeans::SimpleMatrix<double, int>(nr, 0, data.data()), 5, centers.data()), 0);
+}
+
+TEST(KmeansParallelInitialization, Options) {
+    kmeans::InitializeKmeansParallelOptions opt;
+    opt.seed = 12345;
+    opt.num_rounds = 10;
+    kmeans::InitializeKmeansParallel init(opt);
+    EXPECT_EQ(init.get_options().seed, 12345);
+    EXPECT_EQ(init.get_options().num_rounds, 10);
+
+    init.get_options().seed = 99999;
+    EXPECT_EQ(init.get_options().seed, 99999);
+}
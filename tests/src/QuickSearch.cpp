@@ -83,11 +83,209 @@ TEST_P(QuickSearchTest, TakeTwo) {
     }
 }
 
+TEST_P(QuickSearchTest, FindK) {
+    auto half_nc = nc/2;
+    kmeans::internal::QuickSearch<double, int, int> index(nr, half_nc, data.data()); 
+
+    for (int m : { 1, 2, 5, half_nc, half_nc + 3 }) {
+        std::vector<int> indices(m);
+        std::vector<double> distances(m);
+
+        for (int c = half_nc; c < nc; ++c) {
+            auto self = data.data() + c * nr;
+            int found = index.find_k(self, m, indices.data(), distances.data());
+            int expected_found = std::min(m, half_nc);
+            EXPECT_EQ(found, expected_found);
+
+            std::vector<std::pair<double, int> > expected;
+            for (int b = 0; b < half_nc; ++b) {
+                double d2 = 0;
+                auto other = data.data() + b * nr;
+                for (int r = 0; r < nr; ++r) {
+                    double delta = other[r] - self[r];
+                    d2 += delta * delta;
+                }
+                expected.emplace_back(d2, b);
+            }
+            std::sort(expected.begin(), expected.end());
+
+            for (int i = 0; i < expected_found; ++i) {
+                EXPECT_EQ(indices[i], expected[i].second);
+                EXPECT_EQ(distances[i], std::sqrt(expected[i].first));
+            }
+
+            // Consistent with the other methods.
+            if (found >= 1) {
+                auto best = index.find_with_distance(self);
+                EXPECT_EQ(best.first, indices[0]);
+                EXPECT_EQ(best.second, distances[0]);
+            }
+            if (found >= 2) {
+                auto best2 = index.find2(self);
+                EXPECT_EQ(best2.first, indices[0]);
+                EXPECT_EQ(best2.second, indices[1]);
+            }
+        }
+    }
+
+    // Behaves correctly with an empty tree.
+    kmeans::internal::QuickSearch<double, int, int> empty(nr, 0, data.data()); 
+    std::vector<int> indices(5);
+    std::vector<double> distances(5);
+    EXPECT_EQ(empty.find_k(data.data(), 5, indices.data(), distances.data()), 0);
+}
+
+TEST_P(QuickSearchTest, Batched) {
+    kmeans::internal::QuickSearch index(nr, nc, data.data()); 
+    auto half_nc = nc/2;
+    kmeans::internal::QuickSearch half_index(nr, half_nc, data.data()); 
+    kmeans::internal::QuickSearch<double, int, int>::BatchWorkspace work;
+
+    // Trying a variety of batch sizes, re-using the same workspace.
+    for (int batch : { 1, 7, nc }) {
+        for (int start = 0; start < nc; start += batch) {
+            int num = std::min(batch, nc - start);
+            auto ptr = data.data() + start * nr;
+
+            std::vector<int> best(num);
+            half_index.find_batch(num, ptr, best.data(), work);
+            for (int i = 0; i < num; ++i) {
+                EXPECT_EQ(best[i], half_index.find(ptr + i * nr));
+            }
+
+            std::vector<int> first(num), second(num);
+            index.find2_batch(num, ptr, first.data(), second.data(), work);
+            for (int i = 0; i < num; ++i) {
+                auto expected = index.find2(ptr + i * nr);
+                EXPECT_EQ(first[i], expected.first);
+                EXPECT_EQ(second[i], expected.second);
+            }
+        }
+    }
+}
+
+TEST_P(QuickSearchTest, Parallel) {
+    kmeans::internal::QuickSearch<double, int, int> index(nr, nc, data.data()); 
+    for (int nthreads : { 2, 3, 8 }) {
+        // Should get exactly the same tree, so the results should be the same, including ties.
+        kmeans::internal::QuickSearch<double, int, int> pindex(nr, nc, data.data(), nthreads); 
+        for (int c = 0; c < nc; ++c) {
+            auto ptr = data.data() + c * nr;
+            EXPECT_EQ(index.find(ptr), pindex.find(ptr));
+            EXPECT_EQ(index.find2(ptr), pindex.find2(ptr));
+        }
+    }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     QuickSearch,
     QuickSearchTest,
     ::testing::Combine(
-        ::testing::Values(10, 20), // number of dimensions
+        ::testing::Values(3, 10, 20), // number of dimensions, with and without partial distance calculations
         ::testing::Values(2, 10, 50) // number of observations 
     )
 );
+
+TEST(QuickSearch, ParallelTies) {
+    // Lots of duplicate points, so the tie-breaking depends on the exact structure of the tree.
+    int nr = 5, nc = 1000;
+    std::vector<double> data(nr * nc);
+    std::mt19937_64 rng(42);
+    for (auto& d : data) {
+        d = rng() % 3;
+    }
+
+    kmeans::internal::QuickSearch<double, int, int> index(nr, nc, data.data()); 
+    for (int nthreads : { 2, 3, 8 }) {
+        kmeans::internal::QuickSearch<double, int, int> pindex(nr, nc, data.data(), nthreads); 
+        for (int c = 0; c < nc; ++c) {
+            auto ptr = data.data() + c * nr;
+            EXPECT_EQ(index.find(ptr), pindex.find(ptr));
+            EXPECT_EQ(index.find2(ptr), pindex.find2(ptr));
+        }
+    }
+}
+
+TEST(QuickSearch, Update) {
+    int nr = 3, nc = 500, nq = 1000;
+    std::mt19937_64 rng(69);
+    std::uniform_real_distribution<double> unif;
+    std::vector<double> data(nr * nc), queries(nr * nq);
+    for (auto& d : data) {
+        d = unif(rng);
+    }
+    for (auto& q : queries) {
+        q = unif(rng);
+    }
+
+    auto check = [&](const kmeans::internal::QuickSearch<double, int, int>& index) -> void {
+        kmeans::internal::QuickSearch<double, int, int>::BatchWorkspace work;
+        std::vector<int> first(nq), second(nq);
+        index.find2_batch(nq, queries.data(), first.data(), second.data(), work);
+
+        for (int q = 0; q < nq; ++q) {
+            auto self = queries.data() + q * nr;
+            std::vector<std::pair<double, int> > expected;
+            for (int c = 0; c < nc; ++c) {
+                double d2 = 0;
+                for (int r = 0; r < nr; ++r) {
+                    double delta = data[c * nr + r] - self[r];
+                    d2 += delta * delta;
+                }
+                expected.emplace_back(d2, c);
+            }
+            std::partial_sort(expected.begin(), expected.begin() + 2, expected.end());
+
+            auto best = index.find_with_distance(self);
+            EXPECT_EQ(best.first, expected[0].second);
+            EXPECT_EQ(best.second, std::sqrt(expected[0].first));
+
+            auto res = index.find2(self);
+            EXPECT_EQ(res.first, expected[0].second);
+            EXPECT_EQ(res.second, expected[1].second);
+            EXPECT_EQ(first[q], res.first);
+            EXPECT_EQ(second[q], res.second);
+        }
+    };
+
+    kmeans::internal::QuickSearch<double, int, int> index(nr, nc, data.data()); 
+    check(index);
+
+    // Nothing happens if nothing moves.
+    EXPECT_FALSE(index.update(data.data()));
+    check(index);
+
+    // Small movements cause a refit.
+    std::normal_distribution<double> norm(0, 1e-4);
+    for (int it = 0; it < 5; ++it) {
+        for (auto& d : data) {
+            d += norm(rng);
+        }
+        EXPECT_FALSE(index.update(data.data()));
+        check(index);
+    }
+
+    // Refitting with multiple threads gives the same results.
+    for (auto& d : data) {
+        d += norm(rng);
+    }
+    auto copy = index;
+    EXPECT_FALSE(copy.update(data.data(), 3));
+    EXPECT_FALSE(index.update(data.data()));
+    for (int q = 0; q < nq; ++q) {
+        auto self = queries.data() + q * nr;
+        EXPECT_EQ(index.find2(self), copy.find2(self));
+    }
+
+    // Large movements cause a rebuild, which should be the same as building from scratch.
+    for (auto& d : data) {
+        d = unif(rng);
+    }
+    EXPECT_TRUE(index.update(data.data()));
+    check(index);
+    kmeans::internal::QuickSearch<double, int, int> fresh(nr, nc, data.data()); 
+    for (int q = 0; q < nq; ++q) {
+        auto self = queries.data() + q * nr;
+        EXPECT_EQ(index.find2(self), fresh.find2(self));
+    }
+}
@@ -0,0 +1,195 @@
+#include "TestCore.h"
+
+#ifdef CUSTOM_PARALLEL_TEST
+// Must be before any kmeans imports.
+#include "custom_parallel.h"
+#endif
+
+#include "kmeans/RefineFiltering.hpp"
+#include "kmeans/RefineLloyd.hpp"
+
+class RefineFilteringBasicTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+};
+
+TEST_P(RefineFilteringBasicTest, Sweep) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+
+    std::vector<int> clusters(nc);
+    kmeans::RefineFiltering fl;
+    auto res = fl.run(mat, ncenters, centers.data(), clusters.data());
+
+    // Checking that there's the specified number of clusters, and that they're all non-empty.
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+    EXPECT_TRUE(res.iterations > 0);
+
+    // Checking that we get the same results as Lloyd. We skip this if there
+    // are empty clusters, as their centers collapse onto the same location
+    // and the resulting ties are broken differently by the two algorithms.
+    // The centroids are only compared approximately as the sums are computed
+    // in a different order.
+    kmeans::RefineLloyd ll;
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+    if (std::find(lres.sizes.begin(), lres.sizes.end(), 0) == lres.sizes.end()) {
+        for (size_t i = 0; i < centers.size(); ++i) {
+            EXPECT_NEAR(lcenters[i], centers[i], 1e-8);
+        }
+        EXPECT_EQ(lclusters, clusters);
+        EXPECT_EQ(lres.sizes, res.sizes);
+        EXPECT_EQ(lres.iterations, res.iterations);
+        EXPECT_EQ(lres.status, res.status);
+    }
+
+    // Checking that parallelization gives exactly the same result.
+    {
+        kmeans::RefineFilteringOptions popt;
+        popt.num_threads = 3;
+        kmeans::RefineFiltering pfl(popt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+        pfl.run(mat, ncenters, pcenters.data(), pclusters.data());
+
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+    }
+}
+
+TEST_P(RefineFilteringBasicTest, Sanity) {
+    auto ncenters = std::get<1>(GetParam());
+    auto dups = create_jittered_matrix(ncenters);
+    kmeans::SimpleMatrix mat(nr, nc, dups.data.data());
+
+    // Filtering should give us back the perfect clusters.
+    std::vector<int> clusters(nc);
+    kmeans::RefineFiltering fl;
+    auto res = fl.run(mat, ncenters, dups.centers.data(), clusters.data());
+
+    EXPECT_EQ(clusters, dups.clusters);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RefineFiltering,
+    RefineFilteringBasicTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(2, 5, 10), // number of dimensions
+            ::testing::Values(20, 200, 2000) // number of observations
+        ),
+        ::testing::Values(2, 5, 10) // number of clusters
+    )
+);
+
+class RefineFilteringConstantTest : public TestCore, public ::testing::Test {
+protected:
+    void SetUp() {
+        assemble({ 3, 5000 });
+    }
+};
+
+TEST_F(RefineFilteringConstantTest, Extremes) {
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    kmeans::RefineFiltering fl;
+
+    {
+        std::vector<double> centers(nr * nc);
+        std::vector<int> clusters(nc);
+        auto res = fl.run(mat, nc, centers.data(), clusters.data());
+        EXPECT_EQ(data, centers);
+    }
+
+    {
+        auto res0 = fl.run(mat, 0, NULL, NULL);
+        EXPECT_TRUE(res0.sizes.empty());
+    }
+}
+
+TEST_F(RefineFilteringConstantTest, ManyCenters) {
+    // Running for longer with more centers, so that the tasks and the skipping of unchanged subtrees are actually used.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    int ncenters = 50;
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineFilteringOptions opt;
+    opt.max_iterations = 100;
+    kmeans::RefineFiltering fl(opt);
+    auto res = fl.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.status, 0);
+
+    kmeans::RefineLloydOptions lopt;
+    lopt.max_iterations = 100;
+    kmeans::RefineLloyd ll(lopt);
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+
+    for (size_t i = 0; i < centers.size(); ++i) {
+        EXPECT_NEAR(lcenters[i], centers[i], 1e-8);
+    }
+    EXPECT_EQ(lclusters, clusters);
+    EXPECT_EQ(lres.iterations, res.iterations);
+
+    // Different leaf sizes and numbers of threads should give the same clusters.
+    for (int leaf : { 1, 3, 20 }) {
+        for (int threads : { 1, 4 }) {
+            kmeans::RefineFilteringOptions opt2 = opt;
+            opt2.leaf_size = leaf;
+            opt2.num_threads = threads;
+            kmeans::RefineFiltering fl2(opt2);
+
+            auto centers2 = original;
+            std::vector<int> clusters2(nc);
+            fl2.run(mat, ncenters, centers2.data(), clusters2.data());
+            EXPECT_EQ(clusters2, clusters);
+        }
+    }
+}
+
+TEST_F(RefineFilteringConstantTest, Duplicates) {
+    // Lots of duplicate observations, so that the bounding boxes collapse to single points.
+    std::vector<double> dups(data.begin(), data.end());
+    for (size_t i = 0; i < dups.size(); ++i) {
+        dups[i] = std::round(dups[i]);
+    }
+    kmeans::SimpleMatrix mat(nr, nc, dups.data());
+
+    int ncenters = 5;
+    std::vector<double> centers(dups.begin() + 1000 * nr, dups.begin() + 1000 * nr + ncenters * nr);
+    std::vector<int> clusters(nc);
+    kmeans::RefineFiltering fl;
+    auto res = fl.run(mat, ncenters, centers.data(), clusters.data());
+
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+}
+
+TEST(RefineFiltering, Options) {
+    kmeans::RefineFilteringOptions opt;
+    opt.num_threads = 10;
+    kmeans::RefineFiltering ref(opt);
+    EXPECT_EQ(ref.get_options().num_threads, 10);
+
+    ref.get_options().num_threads = 9;
+    EXPECT_EQ(ref.get_options().num_threads, 9);
+}
@@ -0,0 +1,152 @@
+#include "TestCore.h"
+
+#ifdef CUSTOM_PARALLEL_TEST
+// Must be before any kmeans imports.
+#include "custom_parallel.h"
+#endif
+
+#include "kmeans/RefineHamerly.hpp"
+#include "kmeans/RefineLloyd.hpp"
+
+class RefineHamerlyBasicTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+};
+
+TEST_P(RefineHamerlyBasicTest, Sweep) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+
+    std::vector<int> clusters(nc);
+    kmeans::RefineHamerly hm;
+    auto res = hm.run(mat, ncenters, centers.data(), clusters.data());
+
+    // Checking that there's the specified number of clusters, and that they're all non-empty.
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+    EXPECT_TRUE(res.iterations > 0);
+
+    // Checking that we get the same results as Lloyd. We skip this if there
+    // are empty clusters, as their centers collapse onto the same location
+    // and the resulting ties are broken differently by the two algorithms.
+    kmeans::RefineLloyd ll;
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+    if (std::find(lres.sizes.begin(), lres.sizes.end(), 0) == lres.sizes.end()) {
+        EXPECT_EQ(lcenters, centers);
+        EXPECT_EQ(lclusters, clusters);
+        EXPECT_EQ(lres.sizes, res.sizes);
+        EXPECT_EQ(lres.iterations, res.iterations);
+        EXPECT_EQ(lres.status, res.status);
+    }
+
+    // Checking that parallelization gives the same result.
+    {
+        kmeans::RefineHamerlyOptions popt;
+        popt.num_threads = 3;
+        kmeans::RefineHamerly phm(popt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+        phm.run(mat, ncenters, pcenters.data(), pclusters.data());
+
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+    }
+}
+
+TEST_P(RefineHamerlyBasicTest, Sanity) {
+    auto ncenters = std::get<1>(GetParam());
+    auto dups = create_jittered_matrix(ncenters);
+    kmeans::SimpleMatrix mat(nr, nc, dups.data.data());
+
+    // Hamerly should give us back the perfect clusters.
+    std::vector<int> clusters(nc);
+    kmeans::RefineHamerly hm;
+    auto res = hm.run(mat, ncenters, dups.centers.data(), clusters.data());
+
+    EXPECT_EQ(clusters, dups.clusters);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RefineHamerly,
+    RefineHamerlyBasicTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(10, 20), // number of dimensions
+            ::testing::Values(20, 200, 2000) // number of observations 
+        ),
+        ::testing::Values(2, 5, 10) // number of clusters 
+    )
+);
+
+class RefineHamerlyConstantTest : public TestCore, public ::testing::Test {
+protected:
+    void SetUp() {
+        assemble({ 20, 50 });
+    }
+};
+
+TEST_F(RefineHamerlyConstantTest, Extremes) {
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    kmeans::RefineHamerly hm;
+
+    {
+        std::vector<double> centers(nr * nc);
+        std::vector<int> clusters(nc);
+        auto res = hm.run(mat, nc, centers.data(), clusters.data());
+        EXPECT_EQ(data, centers);
+    }
+
+    {
+        auto res0 = hm.run(mat, 0, NULL, NULL);
+        EXPECT_TRUE(res0.sizes.empty());
+    }
+}
+
+TEST_F(RefineHamerlyConstantTest, ManyIterations) {
+    // Running for longer, so that the bounds are actually used to skip some distance calculations.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    int ncenters = 7;
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineHamerlyOptions opt;
+    opt.max_iterations = 100;
+    kmeans::RefineHamerly hm(opt);
+    auto res = hm.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.status, 0);
+
+    kmeans::RefineLloydOptions lopt;
+    lopt.max_iterations = 100;
+    kmeans::RefineLloyd ll(lopt);
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+
+    EXPECT_EQ(lcenters, centers);
+    EXPECT_EQ(lclusters, clusters);
+    EXPECT_EQ(lres.iterations, res.iterations);
+}
+
+TEST(RefineHamerly, Options) {
+    kmeans::RefineHamerlyOptions opt;
+    opt.num_threads = 10;
+    kmeans::RefineHamerly ref(opt);
+    EXPECT_EQ(ref.get_options().num_threads, 10);
+
+    ref.get_options().num_threads = 9;
+    EXPECT_EQ(ref.get_options().num_threads, 9);
+}
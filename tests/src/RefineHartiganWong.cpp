@@ -81,6 +81,105 @@ TEST_P(RefineHartiganWongBasicTest, Sweep) {
         EXPECT_EQ(pcenters, centers);
         EXPECT_EQ(pclusters, clusters);
     }
+
+    // Checking that single-precision losses still give sensible results.
+    {
+        kmeans::RefineHartiganWong hw2;
+        hw2.get_options().float_wcss_loss = true;
+
+        auto centers2 = original;
+        std::vector<int> clusters2(nc);
+        auto res2 = hw2.run(mat, ncenters, centers2.data(), clusters2.data());
+
+        std::vector<int> counts(ncenters);
+        for (auto c : clusters2) {
+            EXPECT_TRUE(c >= 0 && c < ncenters);
+            ++counts[c];
+        }
+        EXPECT_EQ(counts, res2.sizes);
+        EXPECT_TRUE(res2.iterations > 0);
+    }
+
+    // Checking that the parallel optimal transfer gives exactly the same results.
+    // Zero threads should be treated as a single thread.
+    for (int threads : { 0, 1, 3 }) {
+        kmeans::RefineHartiganWongOptions popt;
+        popt.parallel_optimal_transfer = true;
+        popt.num_threads = threads;
+        kmeans::RefineHartiganWong phw(popt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+
+        auto pres = phw.run(mat, ncenters, pcenters.data(), pclusters.data());
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+        EXPECT_EQ(pres.iterations, res.iterations);
+        EXPECT_EQ(pres.status, res.status);
+    }
+
+    // Pruning with the triangle inequality gives exactly the same results, with or without parallelization.
+    for (bool parallel : { false, true }) {
+        kmeans::RefineHartiganWongOptions popt;
+        popt.prune_optimal_transfer = true;
+        popt.parallel_optimal_transfer = parallel;
+        popt.num_threads = (parallel ? 3 : 1);
+        kmeans::RefineHartiganWong phw(popt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+
+        auto pres = phw.run(mat, ncenters, pcenters.data(), pclusters.data());
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+        EXPECT_EQ(pres.iterations, res.iterations);
+        EXPECT_EQ(pres.status, res.status);
+    }
+}
+
+TEST_P(RefineHartiganWongBasicTest, Strategies) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineHartiganWongOptions opt;
+    opt.assignment_strategy = kmeans::AssignmentStrategy::VANTAGE_POINT_TREE;
+    kmeans::RefineHartiganWong ref(opt);
+    auto res = ref.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.assignment_strategy, kmeans::AssignmentStrategy::VANTAGE_POINT_TREE);
+
+    for (auto strategy : { kmeans::AssignmentStrategy::AUTOMATIC, kmeans::AssignmentStrategy::BRUTE_FORCE, kmeans::AssignmentStrategy::BLOCKED_DOT_PRODUCT }) {
+        auto sopt = opt;
+        sopt.assignment_strategy = strategy;
+        kmeans::RefineHartiganWong sref(sopt);
+
+        auto scenters = original;
+        std::vector<int> sclusters(nc);
+        auto sres = sref.run(mat, ncenters, scenters.data(), sclusters.data());
+        if (strategy == kmeans::AssignmentStrategy::AUTOMATIC) {
+            EXPECT_NE(sres.assignment_strategy, kmeans::AssignmentStrategy::AUTOMATIC);
+        } else {
+            EXPECT_EQ(sres.assignment_strategy, strategy);
+        }
+
+        EXPECT_EQ(sclusters, clusters);
+        EXPECT_EQ(sres.sizes, res.sizes);
+        EXPECT_EQ(sres.iterations, res.iterations);
+        EXPECT_EQ(scenters, centers);
+
+        // Checking that parallelization gives the same result.
+        sopt.num_threads = 3;
+        kmeans::RefineHartiganWong pref(sopt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+        pref.run(mat, ncenters, pcenters.data(), pclusters.data());
+        EXPECT_EQ(pcenters, scenters);
+        EXPECT_EQ(pclusters, sclusters);
+    }
 }
 
 TEST_P(RefineHartiganWongBasicTest, Sanity) {
@@ -90,10 +189,21 @@ TEST_P(RefineHartiganWongBasicTest, Sanity) {
 
     // HartiganWong should give us back the perfect clusters.
     std::vector<int> clusters(nc);
+    auto original = dups.centers;
     kmeans::RefineHartiganWong hw;
     auto res = hw.run(mat, ncenters, dups.centers.data(), clusters.data());
 
     EXPECT_EQ(clusters, dups.clusters);
+
+    // Same for the single-precision losses.
+    {
+        kmeans::RefineHartiganWongOptions fopt;
+        fopt.float_wcss_loss = true;
+        kmeans::RefineHartiganWong fhw(fopt);
+        std::vector<int> fclusters(nc);
+        fhw.run(mat, ncenters, original.data(), fclusters.data());
+        EXPECT_EQ(fclusters, dups.clusters);
+    }
 }
 
 INSTANTIATE_TEST_SUITE_P(
@@ -157,6 +267,203 @@ TEST_F(RefineHartiganWongConstantTest, QuickTransferFailure) {
     EXPECT_EQ(res.status, 4);
 }
 
+class RefineHartiganWongManyCentersTest : public TestCore, public ::testing::Test { 
+protected:
+    void SetUp() {
+        assemble({ 5, 3000 });
+    }
+};
+
+TEST_F(RefineHartiganWongManyCentersTest, Basic) {
+    // Using more centers so that the live cluster lists and the partial tiles in the candidate scan are exercised.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    for (int ncenters : { 37, 50 }) {
+        auto centers = create_centers(ncenters);
+        auto original = centers;
+        std::vector<int> clusters(nc);
+
+        kmeans::RefineHartiganWongOptions opt;
+        opt.max_iterations = 50;
+        kmeans::RefineHartiganWong hw(opt);
+        auto res = hw.run(mat, ncenters, centers.data(), clusters.data());
+        EXPECT_EQ(res.status, 0);
+
+        std::vector<int> counts(ncenters);
+        for (auto c : clusters) {
+            EXPECT_TRUE(c >= 0 && c < ncenters);
+            ++counts[c];
+        }
+        EXPECT_EQ(counts, res.sizes);
+
+        // No observation should want to move to a different cluster at convergence.
+        for (int o = 0; o < nc; ++o) {
+            auto optr = data.data() + o * nr;
+            auto l1 = clusters[o];
+            double n1 = counts[l1];
+            double loss = 0;
+            for (int r = 0; r < nr; ++r) {
+                double delta = optr[r] - centers[l1 * nr + r];
+                loss += delta * delta;
+            }
+            loss *= n1 / (n1 - 1);
+
+            for (int c = 0; c < ncenters; ++c) {
+                if (c == l1) {
+                    continue;
+                }
+                double n2 = counts[c];
+                double gain = 0;
+                for (int r = 0; r < nr; ++r) {
+                    double delta = optr[r] - centers[c * nr + r];
+                    gain += delta * delta;
+                }
+                gain *= n2 / (n2 + 1);
+                EXPECT_GE(gain, loss * (1 - 1e-8));
+            }
+        }
+
+        for (int threads : { 0, 1, 3 }) {
+            auto popt = opt;
+            popt.parallel_optimal_transfer = true;
+            popt.num_threads = threads;
+            kmeans::RefineHartiganWong phw(popt);
+
+            auto pcenters = original;
+            std::vector<int> pclusters(nc);
+            auto pres = phw.run(mat, ncenters, pcenters.data(), pclusters.data());
+            EXPECT_EQ(pcenters, centers);
+            EXPECT_EQ(pclusters, clusters);
+            EXPECT_EQ(pres.iterations, res.iterations);
+        }
+
+        // Pruning is most likely to skip candidates with many centers.
+        for (bool parallel : { false, true }) {
+            auto popt = opt;
+            popt.prune_optimal_transfer = true;
+            popt.parallel_optimal_transfer = parallel;
+            popt.num_threads = (parallel ? 3 : 1);
+            kmeans::RefineHartiganWong phw(popt);
+
+            auto pcenters = original;
+            std::vector<int> pclusters(nc);
+            auto pres = phw.run(mat, ncenters, pcenters.data(), pclusters.data());
+            EXPECT_EQ(pcenters, centers);
+            EXPECT_EQ(pclusters, clusters);
+            EXPECT_EQ(pres.iterations, res.iterations);
+        }
+    }
+}
+
+TEST_F(RefineHartiganWongManyCentersTest, Recomputation) {
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    int ncenters = 50;
+    auto original = create_centers(ncenters);
+
+    kmeans::RefineHartiganWongOptions opt;
+    opt.max_iterations = 50;
+    auto centers = original;
+    std::vector<int> clusters(nc);
+    kmeans::RefineHartiganWong hw(opt);
+    auto res = hw.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.max_centroid_drift, 0); // not measured by default.
+
+    auto run = [&](const kmeans::RefineHartiganWongOptions& ropt, std::vector<double>& rcenters, std::vector<int>& rclusters) -> kmeans::Details<int> {
+        rcenters = original;
+        rclusters.resize(nc);
+        kmeans::RefineHartiganWong rhw(ropt);
+        return rhw.run(mat, ncenters, rcenters.data(), rclusters.data());
+    };
+
+    // Measuring the drift doesn't change the results.
+    auto mopt = opt;
+    mopt.report_centroid_drift = true;
+    std::vector<double> mcenters;
+    std::vector<int> mclusters;
+    auto mres = run(mopt, mcenters, mclusters);
+    EXPECT_EQ(mcenters, centers);
+    EXPECT_EQ(mclusters, clusters);
+    EXPECT_GT(mres.max_centroid_drift, 0);
+    EXPECT_LT(mres.max_centroid_drift, 1e-10);
+
+    // Recomputing whenever any update was made, or in every iteration, is the same as the default.
+    {
+        auto dopt = mopt;
+        dopt.centroid_recomputation = kmeans::CentroidRecomputation::DRIFT;
+        dopt.centroid_recomputation_max_updates = 0;
+        std::vector<double> dcenters;
+        std::vector<int> dclusters;
+        auto dres = run(dopt, dcenters, dclusters);
+        EXPECT_EQ(dcenters, centers);
+        EXPECT_EQ(dclusters, clusters);
+        EXPECT_EQ(dres.max_centroid_drift, mres.max_centroid_drift);
+
+        auto popt = mopt;
+        popt.centroid_recomputation = kmeans::CentroidRecomputation::PERIODIC;
+        popt.centroid_recomputation_interval = 1;
+        std::vector<double> pcenters;
+        std::vector<int> pclusters;
+        auto pres = run(popt, pcenters, pclusters);
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+    }
+
+    // Less frequent recomputation gives the same clusters, and the final centroids are still recomputed from scratch.
+    for (int setting = 0; setting < 3; ++setting) {
+        auto sopt = mopt;
+        if (setting == 0) {
+            sopt.centroid_recomputation = kmeans::CentroidRecomputation::PERIODIC;
+            sopt.centroid_recomputation_interval = 3;
+        } else if (setting == 1) {
+            sopt.centroid_recomputation = kmeans::CentroidRecomputation::DRIFT;
+            sopt.centroid_recomputation_max_updates = 100;
+        } else {
+            sopt.centroid_recomputation = kmeans::CentroidRecomputation::DRIFT;
+            sopt.centroid_recomputation_max_updates = 1000000;
+        }
+
+        std::vector<double> scenters;
+        std::vector<int> sclusters;
+        auto sres = run(sopt, scenters, sclusters);
+        EXPECT_EQ(sclusters, clusters);
+        EXPECT_EQ(sres.iterations, res.iterations);
+        EXPECT_LT(sres.max_centroid_drift, 1e-10);
+
+        auto expected = scenters;
+        kmeans::internal::compute_centroids(mat, ncenters, expected.data(), sclusters.data(), sres.sizes, 1);
+        EXPECT_EQ(expected, scenters);
+    }
+}
+
+TEST_F(RefineHartiganWongManyCentersTest, UpdateCenters) {
+    // Checking that the center-to-center distances are correctly updated after transfers.
+    int ncenters = 20;
+    auto centers = create_centers(ncenters);
+    std::vector<int> clusters(nc);
+    for (int o = 0; o < nc; ++o) {
+        clusters[o] = o % ncenters;
+    }
+
+    kmeans::RefineHartiganWong_internal::Workspace<double, int, int> work(nc, ncenters);
+    work.prune = true;
+    for (auto c : clusters) {
+        ++work.clusters[c].size;
+    }
+    kmeans::RefineHartiganWong_internal::prepare_centers(nr, ncenters, centers.data(), work, 1);
+
+    for (int o = 0; o < 100; ++o) {
+        int l1 = clusters[o], l2 = (l1 + 7) % ncenters;
+        kmeans::RefineHartiganWong_internal::transfer_point(nr, data.data() + o * nr, o, l1, l2, centers.data(), clusters.data(), work);
+        kmeans::RefineHartiganWong_internal::update_centers(nr, ncenters, l1, l2, centers.data(), work);
+    }
+
+    auto updated = work.center_distances;
+    auto packed = work.packed_centers;
+    kmeans::RefineHartiganWong_internal::prepare_centers(nr, ncenters, centers.data(), work, 1);
+    EXPECT_EQ(updated, work.center_distances);
+    EXPECT_EQ(packed, work.packed_centers);
+}
+
 TEST(RefineHartiganWong, Options) {
     kmeans::RefineHartiganWongOptions opt;
     opt.num_threads = 10;
@@ -49,6 +49,84 @@ TEST_P(RefineLloydBasicTest, Sweep) {
     }
 }
 
+TEST_P(RefineLloydBasicTest, Incremental) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+
+    std::vector<int> clusters(nc);
+    kmeans::RefineLloyd ll;
+    auto res = ll.run(mat, ncenters, centers.data(), clusters.data());
+
+    for (int interval : { 2, 3, 1000 }) {
+        kmeans::RefineLloydOptions iopt;
+        iopt.centroid_recompute_interval = interval;
+        kmeans::RefineLloyd ill(iopt);
+
+        auto icenters = original;
+        std::vector<int> iclusters(nc);
+        auto ires = ill.run(mat, ncenters, icenters.data(), iclusters.data());
+
+        // Incremental updates may introduce some floating-point error in the centers.
+        EXPECT_EQ(iclusters, clusters);
+        EXPECT_EQ(ires.sizes, res.sizes);
+        EXPECT_EQ(ires.iterations, res.iterations);
+        for (size_t i = 0; i < centers.size(); ++i) {
+            EXPECT_NEAR(icenters[i], centers[i], 1e-8);
+        }
+    }
+}
+
+TEST_P(RefineLloydBasicTest, Strategies) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineLloydOptions opt;
+    opt.assignment_strategy = kmeans::AssignmentStrategy::VANTAGE_POINT_TREE;
+    kmeans::RefineLloyd ref(opt);
+    auto res = ref.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.assignment_strategy, kmeans::AssignmentStrategy::VANTAGE_POINT_TREE);
+
+    for (auto strategy : { kmeans::AssignmentStrategy::AUTOMATIC, kmeans::AssignmentStrategy::BRUTE_FORCE, kmeans::AssignmentStrategy::BLOCKED_DOT_PRODUCT }) {
+        auto sopt = opt;
+        sopt.assignment_strategy = strategy;
+        kmeans::RefineLloyd sref(sopt);
+
+        auto scenters = original;
+        std::vector<int> sclusters(nc);
+        auto sres = sref.run(mat, ncenters, scenters.data(), sclusters.data());
+        if (strategy == kmeans::AssignmentStrategy::AUTOMATIC) {
+            EXPECT_NE(sres.assignment_strategy, kmeans::AssignmentStrategy::AUTOMATIC);
+        } else {
+            EXPECT_EQ(sres.assignment_strategy, strategy);
+        }
+
+        // Empty clusters have their centers set to zero, in which case ties are broken differently by each strategy. 
+        if (std::find(res.sizes.begin(), res.sizes.end(), 0) == res.sizes.end()) {
+            EXPECT_EQ(sclusters, clusters);
+            EXPECT_EQ(sres.sizes, res.sizes);
+            EXPECT_EQ(sres.iterations, res.iterations);
+            EXPECT_EQ(scenters, centers);
+        }
+
+        // Checking that parallelization gives the same result.
+        sopt.num_threads = 3;
+        kmeans::RefineLloyd pref(sopt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+        pref.run(mat, ncenters, pcenters.data(), pclusters.data());
+        EXPECT_EQ(pcenters, scenters);
+        EXPECT_EQ(pclusters, sclusters);
+    }
+}
+
 TEST_P(RefineLloydBasicTest, Sanity) {
     auto ncenters = std::get<1>(GetParam());
     auto dups = create_jittered_matrix(ncenters);
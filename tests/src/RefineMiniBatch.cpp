@@ -36,13 +36,14 @@ TEST_P(RefineMiniBatchBasicTest, Sweep) {
     EXPECT_EQ(counts, res.sizes);
     EXPECT_TRUE(res.iterations > 0);
 
-    // Checking that parallelization gives the same result.
-    {
+    // Checking that parallelization gives the same result. We also try more
+    // threads than clusters, so that some threads own no clusters at all.
+    for (int threads : { 3, 8, 13 }) {
         auto pcenters = original;
         std::vector<int> pclusters(nc);
 
         auto popt = opt;
-        popt.num_threads = 3;
+        popt.num_threads = threads;
         kmeans::RefineMiniBatch pmb(popt);
         pmb.run(mat, ncenters, pcenters.data(), pclusters.data());
 
@@ -51,6 +52,284 @@ TEST_P(RefineMiniBatchBasicTest, Sweep) {
     }
 }
 
+TEST_P(RefineMiniBatchBasicTest, Streaming) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineMiniBatchOptions opt;
+    opt.batch_size = 30; // not a multiple of the number of observations, so the last chunk is smaller.
+    opt.streaming = true;
+    kmeans::RefineMiniBatch mb(opt);
+    auto res = mb.run(mat, ncenters, centers.data(), clusters.data());
+
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+    EXPECT_TRUE(res.iterations > 0);
+
+    // Checking that parallelization gives the same result, including when
+    // one thread is loading the next chunk while the other is searching.
+    for (int threads : { 2, 3 }) {
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+
+        auto popt = opt;
+        popt.num_threads = threads;
+        kmeans::RefineMiniBatch pmb(popt);
+        auto pres = pmb.run(mat, ncenters, pcenters.data(), pclusters.data());
+
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+        EXPECT_EQ(pres.iterations, res.iterations);
+    }
+}
+
+TEST_P(RefineMiniBatchBasicTest, StreamingSmallBatch) {
+    auto ncenters = std::get<1>(GetParam());
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto original = create_centers(ncenters);
+
+    // Non-positive batch sizes are treated as a chunk size of 1.
+    kmeans::RefineMiniBatchOptions opt;
+    opt.streaming = true;
+    opt.batch_size = 1;
+    opt.max_iterations = 50;
+    auto ref_centers = original;
+    std::vector<int> ref_clusters(nc);
+    kmeans::RefineMiniBatch ref_mb(opt);
+    auto ref_res = ref_mb.run(mat, ncenters, ref_centers.data(), ref_clusters.data());
+
+    for (int batch_size : { 0, -1 }) {
+        auto centers = original;
+        std::vector<int> clusters(nc);
+        auto copt = opt;
+        copt.batch_size = batch_size;
+        kmeans::RefineMiniBatch mb(copt);
+        auto res = mb.run(mat, ncenters, centers.data(), clusters.data());
+
+        EXPECT_EQ(centers, ref_centers);
+        EXPECT_EQ(clusters, ref_clusters);
+        EXPECT_EQ(res.iterations, ref_res.iterations);
+    }
+}
+
+TEST(RefineMiniBatch, ChunkStreamer) {
+    int nr = 3, nc = 47;
+    std::vector<double> data(nr * nc);
+    std::iota(data.begin(), data.end(), 0);
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    for (int threads : { 1, 3 }) {
+        kmeans::RefineMiniBatch_internal::ChunkStreamer<int, double> streamer;
+        std::mt19937_64 rng(42);
+        streamer.initialize(mat, 10, rng);
+
+        // Running through a few epochs to check that every observation is seen exactly once in each epoch.
+        std::vector<int> chosen;
+        for (int epoch = 0; epoch < 3; ++epoch) {
+            std::vector<int> seen(nc);
+            for (int chunk = 0; chunk < 5; ++chunk) {
+                streamer.current(chosen);
+                EXPECT_EQ(chosen.size(), chosen.front() == 40 ? 7 : 10);
+                for (size_t i = 0; i < chosen.size(); ++i) {
+                    EXPECT_EQ(chosen[i], chosen.front() + static_cast<int>(i));
+                    ++seen[chosen[i]];
+                }
+
+                std::vector<int> processed(chosen.size());
+                streamer.process(mat, threads, true, rng, [&](int start, int length, const double* buffer) -> void {
+                    for (int i = 0; i < length; ++i) {
+                        auto expected = data.data() + (chosen[start + i]) * nr;
+                        EXPECT_EQ(std::vector<double>(buffer + i * nr, buffer + (i + 1) * nr), std::vector<double>(expected, expected + nr));
+                        ++processed[start + i];
+                    }
+                });
+                EXPECT_EQ(processed, std::vector<int>(chosen.size(), 1));
+                streamer.advance();
+            }
+            EXPECT_EQ(seen, std::vector<int>(nc, 1));
+        }
+    }
+}
+
+TEST_P(RefineMiniBatchBasicTest, ParallelSampling) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineMiniBatchOptions opt;
+    opt.batch_size = 100;
+    opt.parallel_sampling = true;
+    kmeans::RefineMiniBatch mb(opt);
+    auto res = mb.run(mat, ncenters, centers.data(), clusters.data());
+
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+    EXPECT_TRUE(res.iterations > 0);
+
+    // Results should be exactly the same for any number of threads.
+    for (int threads : { 2, 3, 8 }) {
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+
+        auto popt = opt;
+        popt.num_threads = threads;
+        kmeans::RefineMiniBatch pmb(popt);
+        auto pres = pmb.run(mat, ncenters, pcenters.data(), pclusters.data());
+
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+        EXPECT_EQ(pres.iterations, res.iterations);
+    }
+}
+
+TEST(RefineMiniBatch, ParallelSampler) {
+    int nobs = 1000;
+    kmeans::RefineMiniBatch_internal::ParallelSampler<int> sampler;
+
+    for (int batch_size : { 0, 1, 50, 999, 1000 }) {
+        std::vector<int> ref;
+        sampler.run(nobs, batch_size, 42, 0, ref, 1);
+        EXPECT_EQ(ref.size(), batch_size);
+        EXPECT_TRUE(std::is_sorted(ref.begin(), ref.end()));
+        EXPECT_TRUE(std::adjacent_find(ref.begin(), ref.end()) == ref.end());
+        for (auto r : ref) {
+            EXPECT_TRUE(r >= 0 && r < nobs);
+        }
+
+        // Same sample for any number of threads.
+        for (int threads : { 2, 3, 7 }) {
+            std::vector<int> chosen;
+            sampler.run(nobs, batch_size, 42, 0, chosen, threads);
+            EXPECT_EQ(chosen, ref);
+        }
+
+        // Different samples in different iterations.
+        if (batch_size > 0 && batch_size < nobs) {
+            std::vector<int> next;
+            sampler.run(nobs, batch_size, 42, 1, next, 1);
+            EXPECT_NE(next, ref);
+        }
+    }
+
+    // Each observation is sampled at roughly the expected frequency.
+    std::vector<int> frequency(nobs);
+    std::vector<int> chosen;
+    int niters = 200, batch_size = 100;
+    for (int it = 0; it < niters; ++it) {
+        sampler.run(nobs, batch_size, 69, it, chosen, 3);
+        for (auto c : chosen) {
+            ++frequency[c];
+        }
+    }
+    double expected = static_cast<double>(niters) * batch_size / nobs;
+    for (auto f : frequency) {
+        EXPECT_LT(std::abs(f - expected), expected);
+    }
+}
+
+TEST_P(RefineMiniBatchBasicTest, FinalPass) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto original = create_centers(ncenters);
+
+    kmeans::RefineMiniBatchOptions opt;
+    opt.batch_size = 100;
+    auto run = [&](kmeans::MiniBatchFinalPass pass, std::vector<double>& centers, std::vector<int>& clusters) -> kmeans::Details<int> {
+        auto fopt = opt;
+        fopt.final_pass = pass;
+        kmeans::RefineMiniBatch mb(fopt);
+        centers = original;
+        clusters.resize(nc);
+        return mb.run(mat, ncenters, centers.data(), clusters.data());
+    };
+
+    std::vector<double> full_centers, assign_centers, none_centers;
+    std::vector<int> full_clusters, assign_clusters, none_clusters;
+    auto full_res = run(kmeans::MiniBatchFinalPass::FULL, full_centers, full_clusters);
+    auto assign_res = run(kmeans::MiniBatchFinalPass::ASSIGN_ONLY, assign_centers, assign_clusters);
+    auto none_res = run(kmeans::MiniBatchFinalPass::NONE, none_centers, none_clusters);
+
+    EXPECT_EQ(none_res.sizes, std::vector<int>(ncenters));
+    EXPECT_EQ(none_res.iterations, full_res.iterations);
+
+    // Skipping the centroid recomputation returns the centroids from the mini-batch iterations.
+    EXPECT_EQ(assign_centers, none_centers);
+    EXPECT_EQ(assign_clusters, full_clusters);
+    EXPECT_EQ(assign_res.sizes, full_res.sizes);
+
+    // Deferring the assignment gives the same clusters.
+    std::vector<int> deferred(nc);
+    auto deferred_sizes = kmeans::assign(mat, ncenters, none_centers.data(), deferred.data(), kmeans::AssignOptions());
+    EXPECT_EQ(deferred, full_clusters);
+    EXPECT_EQ(deferred_sizes, full_res.sizes);
+
+    auto expected = none_centers;
+    kmeans::internal::compute_centroids(mat, ncenters, expected.data(), deferred.data(), deferred_sizes, 1);
+    EXPECT_EQ(expected, full_centers);
+}
+
+TEST_P(RefineMiniBatchBasicTest, Strategies) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineMiniBatchOptions opt;
+    opt.batch_size = 100;
+    opt.assignment_strategy = kmeans::AssignmentStrategy::VANTAGE_POINT_TREE;
+    kmeans::RefineMiniBatch ref(opt);
+    auto res = ref.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.assignment_strategy, kmeans::AssignmentStrategy::VANTAGE_POINT_TREE);
+
+    for (auto strategy : { kmeans::AssignmentStrategy::AUTOMATIC, kmeans::AssignmentStrategy::BRUTE_FORCE, kmeans::AssignmentStrategy::BLOCKED_DOT_PRODUCT }) {
+        auto sopt = opt;
+        sopt.assignment_strategy = strategy;
+        kmeans::RefineMiniBatch sref(sopt);
+
+        auto scenters = original;
+        std::vector<int> sclusters(nc);
+        auto sres = sref.run(mat, ncenters, scenters.data(), sclusters.data());
+        if (strategy == kmeans::AssignmentStrategy::AUTOMATIC) {
+            EXPECT_NE(sres.assignment_strategy, kmeans::AssignmentStrategy::AUTOMATIC);
+        } else {
+            EXPECT_EQ(sres.assignment_strategy, strategy);
+        }
+
+        EXPECT_EQ(sclusters, clusters);
+        EXPECT_EQ(sres.sizes, res.sizes);
+        EXPECT_EQ(sres.iterations, res.iterations);
+        EXPECT_EQ(scenters, centers);
+
+        // Checking that parallelization gives the same result.
+        sopt.num_threads = 3;
+        kmeans::RefineMiniBatch pref(sopt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+        pref.run(mat, ncenters, pcenters.data(), pclusters.data());
+        EXPECT_EQ(pcenters, scenters);
+        EXPECT_EQ(pclusters, sclusters);
+    }
+}
+
 TEST_P(RefineMiniBatchBasicTest, Sanity) {
     auto ncenters = std::get<1>(GetParam());
     auto dups = create_jittered_matrix(ncenters);
@@ -0,0 +1,224 @@
+#include "TestCore.h"
+
+#ifdef CUSTOM_PARALLEL_TEST
+// Must be before any kmeans imports.
+#include "custom_parallel.h"
+#endif
+
+#include "kmeans/RefineNestedMiniBatch.hpp"
+#include "kmeans/RefineLloyd.hpp"
+
+class RefineNestedMiniBatchBasicTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+};
+
+TEST_P(RefineNestedMiniBatchBasicTest, Sweep) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineNestedMiniBatchOptions opt;
+    opt.batch_size = 10; // reducing the batch size so that the doubling actually does something.
+    opt.max_iterations = 1000;
+    kmeans::RefineNestedMiniBatch mb(opt);
+    auto res = mb.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.status, 0);
+
+    // Checking that there's the specified number of clusters.
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+    EXPECT_TRUE(res.iterations > 0);
+
+    // Upon convergence, we should have a Lloyd fixed point where each
+    // observation is assigned to its closest centroid, and each centroid is
+    // the mean of its assigned observations. We skip the first check if
+    // there are empty clusters, as their centroids are set to zero.
+    bool has_empty = std::find(counts.begin(), counts.end(), 0) != counts.end();
+    for (int o = 0; o < nc && !has_empty; ++o) {
+        auto optr = data.data() + o * nr;
+        std::vector<double> dist(ncenters);
+        for (int c = 0; c < ncenters; ++c) {
+            for (int r = 0; r < nr; ++r) {
+                double delta = optr[r] - centers[c * nr + r];
+                dist[c] += delta * delta;
+            }
+        }
+        EXPECT_LE(dist[clusters[o]], *std::min_element(dist.begin(), dist.end()) * (1 + 1e-8));
+    }
+
+    auto expected = centers;
+    kmeans::internal::compute_centroids(mat, ncenters, expected.data(), clusters.data(), res.sizes, 1);
+    EXPECT_EQ(expected, centers);
+
+    // Checking that parallelization gives the same result.
+    {
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+
+        auto popt = opt;
+        popt.num_threads = 3;
+        kmeans::RefineNestedMiniBatch pmb(popt);
+        auto pres = pmb.run(mat, ncenters, pcenters.data(), pclusters.data());
+
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+        EXPECT_EQ(pres.iterations, res.iterations);
+    }
+}
+
+TEST_P(RefineNestedMiniBatchBasicTest, Lloyd) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    // If the initial batch contains all observations, we should get the
+    // same results as Lloyd. We skip this if there are empty clusters, as
+    // their centers collapse onto the same location and the resulting ties
+    // are broken differently by the two algorithms.
+    kmeans::RefineNestedMiniBatchOptions opt;
+    opt.batch_size = nc;
+    opt.max_iterations = 100;
+    kmeans::RefineNestedMiniBatch mb(opt);
+    auto res = mb.run(mat, ncenters, centers.data(), clusters.data());
+
+    kmeans::RefineLloydOptions lopt;
+    lopt.max_iterations = 100;
+    kmeans::RefineLloyd ll(lopt);
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+
+    if (std::find(lres.sizes.begin(), lres.sizes.end(), 0) == lres.sizes.end()) {
+        for (size_t i = 0; i < centers.size(); ++i) {
+            EXPECT_NEAR(lcenters[i], centers[i], 1e-8);
+        }
+        EXPECT_EQ(lclusters, clusters);
+        EXPECT_EQ(lres.sizes, res.sizes);
+        EXPECT_EQ(lres.status, res.status);
+    }
+}
+
+TEST_P(RefineNestedMiniBatchBasicTest, Sanity) {
+    auto ncenters = std::get<1>(GetParam());
+    auto dups = create_jittered_matrix(ncenters);
+    kmeans::SimpleMatrix mat(nr, nc, dups.data.data());
+
+    // Should give us back the perfect clusters.
+    std::vector<int> clusters(nc);
+    kmeans::RefineNestedMiniBatchOptions opt;
+    opt.batch_size = 10;
+    opt.max_iterations = 1000;
+    kmeans::RefineNestedMiniBatch mb(opt);
+    auto res = mb.run(mat, ncenters, dups.centers.data(), clusters.data());
+
+    EXPECT_EQ(clusters, dups.clusters);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RefineNestedMiniBatch,
+    RefineNestedMiniBatchBasicTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(10, 20), // number of dimensions
+            ::testing::Values(20, 200, 2000) // number of observations
+        ),
+        ::testing::Values(2, 5, 10) // number of clusters
+    )
+);
+
+class RefineNestedMiniBatchConstantTest : public TestCore, public ::testing::Test {
+protected:
+    void SetUp() {
+        assemble({ 5, 1000 });
+    }
+};
+
+TEST_F(RefineNestedMiniBatchConstantTest, Extremes) {
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    kmeans::RefineNestedMiniBatch mb;
+
+    {
+        std::vector<double> centers(nr * nc);
+        std::vector<int> clusters(nc);
+        auto res = mb.run(mat, nc, centers.data(), clusters.data());
+        EXPECT_EQ(data, centers);
+    }
+
+    {
+        auto res0 = mb.run(mat, 0, NULL, NULL);
+        EXPECT_TRUE(res0.sizes.empty());
+    }
+}
+
+TEST_F(RefineNestedMiniBatchConstantTest, Unconverged) {
+    // Stopping before the batch contains all observations, in which case all observations are assigned at the end.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    int ncenters = 10;
+    auto centers = create_centers(ncenters);
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineNestedMiniBatchOptions opt;
+    opt.batch_size = 10;
+    opt.max_iterations = 2;
+    opt.assignment_strategy = kmeans::AssignmentStrategy::BRUTE_FORCE;
+    kmeans::RefineNestedMiniBatch mb(opt);
+    auto res = mb.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.status, 2);
+    EXPECT_EQ(res.assignment_strategy, kmeans::AssignmentStrategy::BRUTE_FORCE);
+
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+
+    auto expected = centers;
+    kmeans::internal::compute_centroids(mat, ncenters, expected.data(), clusters.data(), res.sizes, 1);
+    EXPECT_EQ(expected, centers);
+}
+
+TEST(RefineNestedMiniBatch, SampleNew) {
+    std::mt19937_64 rng(42);
+    std::vector<int> batch { 0, 3, 4, 5, 10, 19 };
+    std::vector<int> output;
+
+    for (int number : { 1, 5, 14 }) {
+        kmeans::RefineNestedMiniBatch_internal::sample_new_observations(20, batch, number, output, rng);
+        EXPECT_EQ(output.size(), number);
+        EXPECT_TRUE(std::is_sorted(output.begin(), output.end()));
+        EXPECT_TRUE(std::adjacent_find(output.begin(), output.end()) == output.end());
+        for (auto o : output) {
+            EXPECT_TRUE(o >= 0 && o < 20);
+            EXPECT_TRUE(std::find(batch.begin(), batch.end(), o) == batch.end());
+        }
+    }
+
+    // All remaining observations are taken.
+    kmeans::RefineNestedMiniBatch_internal::sample_new_observations(20, batch, 14, output, rng);
+    std::vector<int> expected { 1, 2, 6, 7, 8, 9, 11, 12, 13, 14, 15, 16, 17, 18 };
+    EXPECT_EQ(output, expected);
+}
+
+TEST(RefineNestedMiniBatch, Options) {
+    kmeans::RefineNestedMiniBatchOptions opt;
+    opt.num_threads = 10;
+    kmeans::RefineNestedMiniBatch ref(opt);
+    EXPECT_EQ(ref.get_options().num_threads, 10);
+
+    ref.get_options().num_threads = 9;
+    EXPECT_EQ(ref.get_options().num_threads, 9);
+}
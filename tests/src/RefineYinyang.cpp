@@ -0,0 +1,212 @@
+#include "TestCore.h"
+
+#ifdef CUSTOM_PARALLEL_TEST
+// Must be before any kmeans imports.
+#include "custom_parallel.h"
+#endif
+
+#include "kmeans/RefineYinyang.hpp"
+#include "kmeans/RefineLloyd.hpp"
+
+class RefineYinyangBasicTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+};
+
+TEST_P(RefineYinyangBasicTest, Sweep) {
+    auto ncenters = std::get<1>(GetParam());
+
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+
+    std::vector<int> clusters(nc);
+    kmeans::RefineYinyang yy;
+    auto res = yy.run(mat, ncenters, centers.data(), clusters.data());
+
+    // Checking that there's the specified number of clusters, and that they're all non-empty.
+    std::vector<int> counts(ncenters);
+    for (auto c : clusters) {
+        EXPECT_TRUE(c >= 0 && c < ncenters);
+        ++counts[c];
+    }
+    EXPECT_EQ(counts, res.sizes);
+    EXPECT_TRUE(res.iterations > 0);
+
+    // Checking that we get the same results as Lloyd. We skip this if there
+    // are empty clusters, as their centers collapse onto the same location
+    // and the resulting ties are broken differently by the two algorithms.
+    kmeans::RefineLloyd ll;
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+    if (std::find(lres.sizes.begin(), lres.sizes.end(), 0) == lres.sizes.end()) {
+        EXPECT_EQ(lcenters, centers);
+        EXPECT_EQ(lclusters, clusters);
+        EXPECT_EQ(lres.sizes, res.sizes);
+        EXPECT_EQ(lres.iterations, res.iterations);
+        EXPECT_EQ(lres.status, res.status);
+    }
+
+    // Checking that the number of groups doesn't change the result,
+    // again skipping this if the empty clusters introduce ties.
+    for (int ngroups : { 1, 3, ncenters }) {
+        if (std::find(res.sizes.begin(), res.sizes.end(), 0) != res.sizes.end()) {
+            break;
+        }
+
+        kmeans::RefineYinyangOptions gopt;
+        gopt.num_groups = ngroups;
+        kmeans::RefineYinyang gyy(gopt);
+
+        auto gcenters = original;
+        std::vector<int> gclusters(nc);
+        gyy.run(mat, ncenters, gcenters.data(), gclusters.data());
+
+        EXPECT_EQ(gcenters, centers);
+        EXPECT_EQ(gclusters, clusters);
+    }
+
+    // Checking that parallelization gives the same result.
+    {
+        kmeans::RefineYinyangOptions popt;
+        popt.num_threads = 3;
+        kmeans::RefineYinyang pyy(popt);
+
+        auto pcenters = original;
+        std::vector<int> pclusters(nc);
+        pyy.run(mat, ncenters, pcenters.data(), pclusters.data());
+
+        EXPECT_EQ(pcenters, centers);
+        EXPECT_EQ(pclusters, clusters);
+    }
+}
+
+TEST_P(RefineYinyangBasicTest, Sanity) {
+    auto ncenters = std::get<1>(GetParam());
+    auto dups = create_jittered_matrix(ncenters);
+    kmeans::SimpleMatrix mat(nr, nc, dups.data.data());
+
+    // Yinyang should give us back the perfect clusters.
+    std::vector<int> clusters(nc);
+    kmeans::RefineYinyang yy;
+    auto res = yy.run(mat, ncenters, dups.centers.data(), clusters.data());
+
+    EXPECT_EQ(clusters, dups.clusters);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RefineYinyang,
+    RefineYinyangBasicTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(10, 20), // number of dimensions
+            ::testing::Values(20, 200, 2000) // number of observations 
+        ),
+        ::testing::Values(2, 5, 10) // number of clusters 
+    )
+);
+
+class RefineYinyangConstantTest : public TestCore, public ::testing::Test {
+protected:
+    void SetUp() {
+        assemble({ 20, 50 });
+    }
+};
+
+TEST_F(RefineYinyangConstantTest, Extremes) {
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    kmeans::RefineYinyang yy;
+
+    {
+        std::vector<double> centers(nr * nc);
+        std::vector<int> clusters(nc);
+        auto res = yy.run(mat, nc, centers.data(), clusters.data());
+        EXPECT_EQ(data, centers);
+    }
+
+    {
+        auto res0 = yy.run(mat, 0, NULL, NULL);
+        EXPECT_TRUE(res0.sizes.empty());
+    }
+}
+
+TEST_F(RefineYinyangConstantTest, ManyIterations) {
+    // Running for longer, so that the bounds are actually used to skip some distance calculations.
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    int ncenters = 7;
+    auto centers = create_centers(ncenters);
+    auto original = centers;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineYinyangOptions opt;
+    opt.max_iterations = 100;
+    kmeans::RefineYinyang yy(opt);
+    auto res = yy.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.status, 0);
+
+    kmeans::RefineLloydOptions lopt;
+    lopt.max_iterations = 100;
+    kmeans::RefineLloyd ll(lopt);
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+
+    EXPECT_EQ(lcenters, centers);
+    EXPECT_EQ(lclusters, clusters);
+    EXPECT_EQ(lres.iterations, res.iterations);
+}
+
+TEST(RefineYinyang, ManyCenters) {
+    // Using more centers so that we get some non-trivial groups.
+    int nr = 5, nc = 1000, ncenters = 50;
+    std::vector<double> data(nr * nc);
+    std::mt19937_64 rng(nr * nc);
+    std::normal_distribution<> norm(0.0, 1.0);
+    for (auto& d : data) {
+        d = norm(rng);
+    }
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    std::vector<double> original(data.begin(), data.begin() + nr * ncenters);
+    auto centers = original;
+    std::vector<int> clusters(nc);
+
+    kmeans::RefineYinyangOptions opt;
+    opt.max_iterations = 100;
+    kmeans::RefineYinyang yy(opt);
+    auto res = yy.run(mat, ncenters, centers.data(), clusters.data());
+    EXPECT_EQ(res.status, 0);
+
+    kmeans::RefineLloydOptions lopt;
+    lopt.max_iterations = 100;
+    kmeans::RefineLloyd ll(lopt);
+    auto lcenters = original;
+    std::vector<int> lclusters(nc);
+    auto lres = ll.run(mat, ncenters, lcenters.data(), lclusters.data());
+
+    EXPECT_EQ(lcenters, centers);
+    EXPECT_EQ(lclusters, clusters);
+    EXPECT_EQ(lres.iterations, res.iterations);
+
+    // Trying again with more groups.
+    yy.get_options().num_groups = 10;
+    auto gcenters = original;
+    std::vector<int> gclusters(nc);
+    yy.run(mat, ncenters, gcenters.data(), gclusters.data());
+    EXPECT_EQ(gcenters, centers);
+    EXPECT_EQ(gclusters, clusters);
+}
+
+TEST(RefineYinyang, Options) {
+    kmeans::RefineYinyangOptions opt;
+    opt.num_threads = 10;
+    kmeans::RefineYinyang ref(opt);
+    EXPECT_EQ(ref.get_options().num_threads, 10);
+
+    ref.get_options().num_threads = 9;
+    EXPECT_EQ(ref.get_options().num_threads, 9);
+}
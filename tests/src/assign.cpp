@@ -0,0 +1,81 @@
+#include "TestCore.h"
+
+#ifdef CUSTOM_PARALLEL_TEST
+// Must be before any kmeans imports.
+#include "custom_parallel.h"
+#endif
+
+#include "kmeans/assign.hpp"
+#include "kmeans/SimpleMatrix.hpp"
+
+class AssignTest : public TestCore, public ::testing::TestWithParam<std::tuple<std::tuple<int, int>, int> > {
+protected:
+    void SetUp() {
+        assemble(std::get<0>(GetParam()));
+    }
+};
+
+TEST_P(AssignTest, Basic) {
+    auto ncenters = std::get<1>(GetParam());
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+    auto centers = create_centers(ncenters);
+
+    std::vector<int> clusters(nc);
+    auto sizes = kmeans::assign(mat, ncenters, centers.data(), clusters.data(), kmeans::AssignOptions());
+
+    // Comparing against a brute-force search.
+    std::vector<int> expected_sizes(ncenters);
+    for (int o = 0; o < nc; ++o) {
+        auto optr = data.data() + o * nr;
+        double best_dist = std::numeric_limits<double>::infinity();
+        int best = -1;
+        for (int c = 0; c < ncenters; ++c) {
+            double d2 = 0;
+            for (int r = 0; r < nr; ++r) {
+                double delta = optr[r] - centers[c * nr + r];
+                d2 += delta * delta;
+            }
+            if (d2 < best_dist) {
+                best_dist = d2;
+                best = c;
+            }
+        }
+        EXPECT_EQ(best, clusters[o]);
+        ++expected_sizes[best];
+    }
+    EXPECT_EQ(sizes, expected_sizes);
+
+    // Same results for other strategies and with parallelization.
+    for (auto strategy : { kmeans::AssignmentStrategy::VANTAGE_POINT_TREE, kmeans::AssignmentStrategy::BRUTE_FORCE }) {
+        for (int threads : { 1, 3 }) {
+            kmeans::AssignOptions opt;
+            opt.assignment_strategy = strategy;
+            opt.num_threads = threads;
+            std::vector<int> clusters2(nc);
+            auto sizes2 = kmeans::assign(mat, ncenters, centers.data(), clusters2.data(), opt);
+            EXPECT_EQ(clusters2, clusters);
+            EXPECT_EQ(sizes2, sizes);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Assign,
+    AssignTest,
+    ::testing::Combine(
+        ::testing::Combine(
+            ::testing::Values(2, 10), // number of dimensions
+            ::testing::Values(20, 200) // number of observations
+        ),
+        ::testing::Values(1, 5, 10) // number of clusters
+    )
+);
+
+TEST(Assign, Empty) {
+    std::vector<double> data(20);
+    kmeans::SimpleMatrix mat(2, 10, data.data());
+    std::vector<int> clusters(10, -1);
+    auto sizes = kmeans::assign(mat, 0, static_cast<double*>(NULL), clusters.data(), kmeans::AssignOptions());
+    EXPECT_TRUE(sizes.empty());
+    EXPECT_EQ(clusters, std::vector<int>(10, -1));
+}
@@ -27,7 +27,7 @@ TEST_P(ComputeCentroidsTest, Basic) {
     }
 
     std::vector<double> centers(ncenters * nr);
-    kmeans::internal::compute_centroids(mat, ncenters, centers.data(), clusters.data(), cluster_size);
+    kmeans::internal::compute_centroids(mat, ncenters, centers.data(), clusters.data(), cluster_size, 1);
 
     // Computing by row for comparison.
     std::vector<double> ref(ncenters * nr);
@@ -41,6 +41,47 @@ TEST_P(ComputeCentroidsTest, Basic) {
     }
 
     EXPECT_EQ(ref, centers);
+
+    // Same results with parallelization.
+    std::vector<double> pcenters(ncenters * nr);
+    kmeans::internal::compute_centroids(mat, ncenters, pcenters.data(), clusters.data(), cluster_size, 3);
+    EXPECT_EQ(pcenters, centers);
+}
+
+TEST_P(ComputeCentroidsTest, Incremental) {
+    auto ncenters = std::get<1>(GetParam());
+    kmeans::SimpleMatrix mat(nr, nc, data.data());
+
+    std::vector<int> clusters(nc);
+    std::vector<int> cluster_size(ncenters);
+    for (int c = 0; c < nc; ++c) {
+        clusters[c] = c % ncenters;
+        ++cluster_size[clusters[c]];
+    }
+
+    std::vector<double> sums(ncenters * nr);
+    kmeans::internal::compute_centroid_sums(mat, ncenters, sums.data(), clusters.data(), 1);
+
+    // Moving every third observation to the next cluster.
+    auto moved = clusters;
+    std::vector<int> changed;
+    for (int c = 0; c < nc; c += 3) {
+        auto& current = moved[c];
+        --cluster_size[current];
+        current = (current + 1) % ncenters;
+        ++cluster_size[current];
+        changed.push_back(c);
+    }
+
+    kmeans::internal::update_centroid_sums(mat, sums.data(), changed, static_cast<const int*>(clusters.data()), static_cast<const int*>(moved.data()));
+    std::vector<double> centers(ncenters * nr);
+    kmeans::internal::compute_centroids_from_sums(nr, ncenters, sums.data(), centers.data(), cluster_size);
+
+    std::vector<double> ref(ncenters * nr);
+    kmeans::internal::compute_centroids(mat, ncenters, ref.data(), moved.data(), cluster_size, 1);
+    for (size_t i = 0; i < ref.size(); ++i) {
+        EXPECT_NEAR(ref[i], centers[i], 1e-8);
+    }
 }
 
 INSTANTIATE_TEST_SUITE_P(
@@ -71,7 +112,7 @@ TEST_P(ComputeCentroidsSingleTest, Basic) {
     std::vector<double> ref(nr);
     std::vector<int> clusters(nc);
     std::vector<int> cluster_size { nc };
-    kmeans::internal::compute_centroids(mat, 1, ref.data(), clusters.data(), cluster_size);
+    kmeans::internal::compute_centroids(mat, 1, ref.data(), clusters.data(), cluster_size, 1);
 
     EXPECT_EQ(ref, center);
 }
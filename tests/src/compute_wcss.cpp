@@ -28,7 +28,7 @@ TEST_P(ComputeWcssTest, Basic) {
     }
 
     std::vector<double> centers(ncenters * nr);
-    kmeans::internal::compute_centroids(mat, ncenters, centers.data(), clusters.data(), cluster_size);
+    kmeans::internal::compute_centroids(mat, ncenters, centers.data(), clusters.data(), cluster_size, 1);
     std::vector<double> wcss(ncenters);
     kmeans::compute_wcss(mat, ncenters, centers.data(), clusters.data(), wcss.data());
 